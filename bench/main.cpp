@@ -0,0 +1,355 @@
+#include "imx/imx.hpp"
+#include "render.hpp"
+#include <array>
+#include <atomic>
+#include <blend2d.h>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <imgui.h>
+#include <map>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+// Feeds synthetic draw data through each stage of the renderer and reports
+// the cost per triangle and glyph, allocations per frame and raster
+// throughput. Nothing here needs an X server.
+
+namespace {
+
+// Counted at the malloc level so that Blend2D's own allocations show up next
+// to those made through operator new. Blend2D may allocate from its worker
+// threads.
+std::atomic<std::size_t> g_allocations = 0;
+
+void count_allocation() {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace
+
+#ifdef __GLIBC__
+// glibc exports its allocator under these names, the definitions below
+// interpose the public ones for the whole process
+extern "C" {
+void *__libc_malloc(std::size_t size);
+void *__libc_calloc(std::size_t count, std::size_t size);
+void *__libc_realloc(void *ptr, std::size_t size);
+void *__libc_memalign(std::size_t alignment, std::size_t size);
+
+void *malloc(std::size_t size) noexcept {
+  count_allocation();
+  return __libc_malloc(size);
+}
+void *calloc(std::size_t count, std::size_t size) noexcept {
+  count_allocation();
+  return __libc_calloc(count, size);
+}
+void *realloc(void *ptr, std::size_t size) noexcept {
+  count_allocation();
+  return __libc_realloc(ptr, size);
+}
+void *memalign(std::size_t alignment, std::size_t size) noexcept {
+  count_allocation();
+  return __libc_memalign(alignment, size);
+}
+void *aligned_alloc(std::size_t alignment, std::size_t size) noexcept {
+  count_allocation();
+  return __libc_memalign(alignment, size);
+}
+int posix_memalign(void **ptr, std::size_t alignment,
+                   std::size_t size) noexcept {
+  if (alignment % sizeof(void *) != 0 ||
+      (alignment & (alignment - 1)) != 0) {
+    return EINVAL;
+  }
+  count_allocation();
+  void *result = __libc_memalign(alignment, size);
+  if (result == nullptr && size != 0) {
+    return ENOMEM;
+  }
+  *ptr = result;
+  return 0;
+}
+}
+#endif
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+  std::string font = "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf";
+  int count = 2000;
+  int iterations = 50;
+  int width = 1920;
+  int height = 1080;
+  std::uint32_t threads = 0;
+};
+
+// Deterministic so every run draws the same frame
+struct generator {
+  std::uint32_t state = 0x12345678U;
+  float next(float low, float high) {
+    state = state * 1664525U + 1013904223U;
+    return low + (high - low) * static_cast<float>(state >> 8U) /
+                     static_cast<float>(1U << 24U);
+  }
+  ImU32 color() {
+    state = state * 1664525U + 1013904223U;
+    return state | IM_COL32_A_MASK;
+  }
+};
+
+void add_rects(ImDrawList &list, generator &rng, int count, ImVec2 size) {
+  for (int i = 0; i < count; ++i) {
+    ImVec2 min(rng.next(0, size.x - 64), rng.next(0, size.y - 64));
+    ImVec2 max(min.x + rng.next(8, 64), min.y + rng.next(8, 64));
+    list.AddRectFilled(min, max, rng.color());
+  }
+}
+
+void add_rounded(ImDrawList &list, generator &rng, int count, ImVec2 size) {
+  for (int i = 0; i < count; ++i) {
+    ImVec2 min(rng.next(0, size.x - 64), rng.next(0, size.y - 64));
+    ImVec2 max(min.x + rng.next(16, 64), min.y + rng.next(16, 64));
+    list.AddRectFilled(min, max, rng.color(), 6.F);
+  }
+}
+
+void add_circles(ImDrawList &list, generator &rng, int count, ImVec2 size) {
+  for (int i = 0; i < count; ++i) {
+    ImVec2 center(rng.next(32, size.x - 32), rng.next(32, size.y - 32));
+    list.AddCircleFilled(center, rng.next(4, 32), rng.color());
+  }
+}
+
+void add_lines(ImDrawList &list, generator &rng, int count, ImVec2 size) {
+  for (int i = 0; i < count; ++i) {
+    ImVec2 from(rng.next(0, size.x), rng.next(0, size.y));
+    ImVec2 to(from.x + rng.next(-64, 64), from.y + rng.next(-64, 64));
+    list.AddLine(from, to, rng.color(), 2.F);
+  }
+}
+
+void add_text(ImDrawList &list, generator &rng, int count, ImVec2 size) {
+  // count is in glyphs, every line is 32 of them
+  constexpr std::string_view s_line = "The quick brown fox jumps over a";
+  for (int i = 0; i < count; i += static_cast<int>(s_line.size())) {
+    ImVec2 pos(rng.next(0, size.x - 400), rng.next(0, size.y - 32));
+    list.AddText(pos, rng.color(), s_line.data(),
+                 s_line.data() + s_line.size());
+  }
+}
+
+void add_mixed(ImDrawList &list, generator &rng, int count, ImVec2 size) {
+  add_rects(list, rng, count / 4, size);
+  add_rounded(list, rng, count / 8, size);
+  add_circles(list, rng, count / 8, size);
+  add_lines(list, rng, count / 4, size);
+  add_text(list, rng, count, size);
+}
+
+struct workload {
+  char const *name;
+  void (*build)(ImDrawList &, generator &, int, ImVec2);
+};
+
+constexpr std::array<workload, 6> s_workloads{{{"rects", add_rects},
+                                               {"rounded", add_rounded},
+                                               {"circles", add_circles},
+                                               {"lines", add_lines},
+                                               {"text", add_text},
+                                               {"mixed", add_mixed}}};
+
+// Average nanoseconds per call of body
+template <typename F> double measure(int iterations, F &&body) {
+  auto start = clock_type::now();
+  for (int i = 0; i < iterations; ++i) {
+    body();
+  }
+  std::chrono::duration<double, std::nano> elapsed = clock_type::now() - start;
+  return elapsed.count() / iterations;
+}
+
+// Average heap allocations per call of body, zero without glibc
+template <typename F> double allocations(int iterations, F &&body) {
+  auto start = g_allocations.load(std::memory_order_relaxed);
+  for (int i = 0; i < iterations; ++i) {
+    body();
+  }
+  auto end = g_allocations.load(std::memory_order_relaxed);
+  return static_cast<double>(end - start) / iterations;
+}
+
+std::size_t count_glyphs(imx::frame_data const &frame) {
+  std::size_t glyphs = 0;
+  for (auto const &list : frame.lists) {
+    for (auto const &cmd : list) {
+      for (auto const &s : cmd.second) {
+        glyphs += std::holds_alternative<imx::text<1>>(s) ? 1 : 0;
+      }
+    }
+  }
+  return glyphs;
+}
+
+ImDrawData const *build_frame(workload const &work, options const &opts) {
+  ImGui::NewFrame();
+  generator rng;
+  work.build(*ImGui::GetBackgroundDrawList(), rng, opts.count,
+             ImGui::GetIO().DisplaySize);
+  ImGui::Render();
+  return ImGui::GetDrawData();
+}
+
+void run_workload(workload const &work, options const &opts, BLImage &target) {
+  auto const *draw_data = build_frame(work, opts);
+  auto triangles = static_cast<double>(draw_data->TotalIdxCount) / 3;
+
+  imx::frame_data frame;
+  // Warm the caches so the steady state is measured
+  imx::convert_frame(frame, draw_data);
+  auto glyphs = count_glyphs(frame);
+
+  std::vector<imx::draw_list> lists;
+  auto convert_ns = measure(
+      opts.iterations, [&] { imx::process_draw_data(lists, draw_data); });
+
+  auto edges_ns = measure(opts.iterations, [&] {
+    for (int n = 0; n < draw_data->CmdListsCount; ++n) {
+      auto const *cmd_list = draw_data->CmdLists[n];
+      auto const *idx_buffer = cmd_list->IdxBuffer.Data;
+      for (auto const &cmd : cmd_list->CmdBuffer) {
+        std::map<imx::edge_t, bool> edges;
+        std::vector<imx::shape> shapes;
+        for (unsigned int i = 0; i < cmd.ElemCount; i += 3) {
+          imx::generate_edges(edges, idx_buffer, cmd_list->VtxBuffer.Data, i,
+                              i, cmd.TextureId);
+        }
+        imx::generate_topology(shapes, edges, cmd_list->VtxBuffer.Data);
+        idx_buffer += cmd.ElemCount;
+      }
+    }
+  });
+
+  auto frame_allocations = allocations(
+      opts.iterations, [&] { imx::convert_frame(frame, draw_data); });
+
+  BLContextCreateInfo info{};
+  info.threadCount = opts.threads;
+  BLContext ctx(target, info);
+  auto render_allocations = allocations(opts.iterations, [&] {
+    imx::render_frame(ctx, frame, BLRgba32(0xFF000000U));
+    ctx.flush(BL_CONTEXT_FLUSH_SYNC);
+  });
+  auto render_ns = measure(opts.iterations, [&] {
+    imx::render_frame(ctx, frame, BLRgba32(0xFF000000U));
+    ctx.flush(BL_CONTEXT_FLUSH_SYNC);
+  });
+  ctx.end();
+
+  auto pixels = static_cast<double>(target.width()) * target.height();
+  fmt::print("{:<8} {:>8.0f} {:>7} {:>12.1f} {:>12.1f} {:>12.1f} {:>9.1f} "
+             "{:>9.1f} {:>9.1f}\n",
+             work.name, triangles, glyphs, convert_ns / triangles,
+             edges_ns / triangles, render_ns / triangles,
+             pixels / render_ns * 1e3, frame_allocations, render_allocations);
+}
+
+// create_glyph in isolation, fed quads placed the way ImGui lays out text
+void run_glyphs(options const &opts) {
+  auto *font = ImGui::GetFont();
+  constexpr std::string_view s_chars =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+  std::vector<std::pair<ImDrawVert, ImDrawVert>> quads;
+  for (int line = 0; line < opts.count / static_cast<int>(s_chars.size());
+       ++line) {
+    float x = 0;
+    auto y = static_cast<float>(line % 40) * font->FontSize;
+    for (char c : s_chars) {
+      auto const *glyph = font->FindGlyph(static_cast<ImWchar>(c));
+      ImDrawVert vtx{{x + glyph->X0, y + glyph->Y0},
+                     {glyph->U0, glyph->V0},
+                     IM_COL32_WHITE};
+      ImDrawVert opposite{{x + glyph->X1, y + glyph->Y1},
+                          {glyph->U1, glyph->V1},
+                          IM_COL32_WHITE};
+      quads.emplace_back(vtx, opposite);
+      x += glyph->AdvanceX;
+    }
+  }
+  if (quads.empty()) {
+    return;
+  }
+  std::vector<imx::shape> output;
+  output.reserve(quads.size());
+  auto glyph_ns = measure(opts.iterations, [&] {
+    output.clear();
+    for (auto const &quad : quads) {
+      imx::create_glyph(output, quad.first, quad.second, 0);
+    }
+  });
+  fmt::print("create_glyph {:>8.1f} ns/glyph over {} glyphs\n",
+             glyph_ns / static_cast<double>(quads.size()), quads.size());
+}
+
+bool parse(options &opts, int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() { return i + 1 < argc ? std::atoi(argv[++i]) : 0; };
+    if (arg == "--count") {
+      opts.count = value();
+    } else if (arg == "--iterations") {
+      opts.iterations = value();
+    } else if (arg == "--width") {
+      opts.width = value();
+    } else if (arg == "--height") {
+      opts.height = value();
+    } else if (arg == "--threads") {
+      opts.threads = static_cast<std::uint32_t>(value());
+    } else if (!arg.empty() && arg.front() != '-') {
+      opts.font = arg;
+    } else {
+      return false;
+    }
+  }
+  return opts.count > 0 && opts.iterations > 0 && opts.width > 0 &&
+         opts.height > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opts;
+  if (!parse(opts, argc, argv)) {
+    fmt::print("usage: imx_bench [font.ttf] [--count n] [--iterations n] "
+               "[--width n] [--height n] [--threads n]\n");
+    return 1;
+  }
+  ImGui::CreateContext();
+  BLImage target(opts.width, opts.height, BL_FORMAT_PRGB32);
+  BLImageData data{};
+  target.getData(&data);
+  if (!imx::initialize_renderer(opts.font, ImVec4{0.F, 0.F, 0.F, 1.F}, {},
+                                data, {})) {
+    return 1;
+  }
+
+  fmt::print("{}x{}, {} threads, {} shapes, {} iterations\n", opts.width,
+             opts.height, opts.threads, opts.count, opts.iterations);
+  fmt::print("{:<8} {:>8} {:>7} {:>12} {:>12} {:>12} {:>9} {:>9} {:>9}\n",
+             "workload", "tris", "glyphs", "convert/tri", "edges/tri",
+             "render/tri", "MPix/s", "alloc/cvt", "alloc/rnd");
+  for (auto const &work : s_workloads) {
+    run_workload(work, opts, target);
+  }
+  run_glyphs(opts);
+  ImGui::DestroyContext();
+  return 0;
+}
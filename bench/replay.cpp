@@ -0,0 +1,140 @@
+#include "capture.hpp"
+#include "imx/imx.hpp"
+#include "render.hpp"
+#include <algorithm>
+#include <blend2d.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <imgui.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Renders a capture recorded with imx::start_capture as fast as possible
+// into an offscreen image and prints the conversion and raster time of
+// every frame as CSV, followed by a summary on stderr.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+struct options {
+  std::string capture;
+  std::string font = "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf";
+  int loops = 1;
+  std::uint32_t threads = 0;
+};
+
+double elapsed_us(clock_type::time_point start, clock_type::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+double percentile(std::vector<double> values, double fraction) {
+  if (values.empty()) {
+    return 0;
+  }
+  auto index = static_cast<std::size_t>(fraction * (values.size() - 1));
+  std::nth_element(values.begin(), values.begin() + index, values.end());
+  return values[index];
+}
+
+bool parse(options &opts, int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    auto value = [&]() { return i + 1 < argc ? std::atoi(argv[++i]) : 0; };
+    if (arg == "--loops") {
+      opts.loops = value();
+    } else if (arg == "--threads") {
+      opts.threads = static_cast<std::uint32_t>(value());
+    } else if (arg == "--font" && i + 1 < argc) {
+      opts.font = argv[++i];
+    } else if (!arg.empty() && arg.front() != '-' && opts.capture.empty()) {
+      opts.capture = arg;
+    } else {
+      return false;
+    }
+  }
+  return !opts.capture.empty() && opts.loops > 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opts;
+  if (!parse(opts, argc, argv)) {
+    fmt::print("usage: imx_replay capture [--font font.ttf] [--loops n] "
+               "[--threads n]\n");
+    return 1;
+  }
+  imx::capture_reader reader(opts.capture);
+  if (!reader.valid()) {
+    return 1;
+  }
+  ImGui::CreateContext();
+  if (!imx::initialize_renderer(opts.font, ImVec4{0.F, 0.F, 0.F, 1.F}, {}, {},
+                                {})) {
+    return 1;
+  }
+  auto &io = ImGui::GetIO();
+  if (reader.atlas_size().x != static_cast<float>(io.Fonts->TexWidth) ||
+      reader.atlas_size().y != static_cast<float>(io.Fonts->TexHeight)) {
+    fmt::print(stderr, "Font atlas differs from the captured one, glyphs "
+                       "will not be recognized\n");
+  }
+  // Conversion looks up the current font, which needs a frame to be set
+  io.DisplaySize = ImVec2(1, 1);
+  ImGui::NewFrame();
+  ImGui::EndFrame();
+
+  BLContextCreateInfo info{};
+  info.threadCount = opts.threads;
+  BLImage target;
+  BLContext ctx;
+  imx::frame_data frame;
+  std::vector<double> convert_times;
+  std::vector<double> render_times;
+
+  fmt::print("frame,lists,triangles,convert_us,render_us\n");
+  int index = 0;
+  for (int loop = 0; loop < opts.loops; ++loop) {
+    reader.rewind();
+    while (auto const *draw_data = reader.next()) {
+      auto width = static_cast<int>(draw_data->DisplaySize.x);
+      auto height = static_cast<int>(draw_data->DisplaySize.y);
+      if (width <= 0 || height <= 0) {
+        continue;
+      }
+      if (target.width() != width || target.height() != height) {
+        ctx.end();
+        target.create(width, height, BL_FORMAT_PRGB32);
+        ctx.begin(target, info);
+      }
+      auto start = clock_type::now();
+      imx::convert_frame(frame, draw_data);
+      auto converted = clock_type::now();
+      imx::render_frame(ctx, frame, BLRgba32(0xFF000000U));
+      ctx.flush(BL_CONTEXT_FLUSH_SYNC);
+      auto rendered = clock_type::now();
+
+      convert_times.push_back(elapsed_us(start, converted));
+      render_times.push_back(elapsed_us(converted, rendered));
+      fmt::print("{},{},{},{:.1f},{:.1f}\n", index++, draw_data->CmdListsCount,
+                 draw_data->TotalIdxCount / 3, convert_times.back(),
+                 render_times.back());
+    }
+  }
+  ctx.end();
+
+  fmt::print(stderr, "{} frames\n", convert_times.size());
+  fmt::print(stderr, "convert us p50 {:.1f} p95 {:.1f} p99 {:.1f}\n",
+             percentile(convert_times, 0.5), percentile(convert_times, 0.95),
+             percentile(convert_times, 0.99));
+  fmt::print(stderr, "render  us p50 {:.1f} p95 {:.1f} p99 {:.1f}\n",
+             percentile(render_times, 0.5), percentile(render_times, 0.95),
+             percentile(render_times, 0.99));
+  ImGui::DestroyContext();
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include "imx/imx.hpp"
+#include <blend2d.h>
+#include <fmt/core.h>
+#include <imgui.h>
+#include <string>
+
+// Renders a few frames of the ImGui demo window without a display server
+// and writes the last one to a PNG file.
+//
+// headless_imx [font.ttf] [output.png]
+int main(int argc, char **argv) {
+  std::string font = argc > 1 ? argv[1]
+                              : "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf";
+  std::string output = argc > 2 ? argv[2] : "headless_imx.png";
+
+  ImGui::CreateContext();
+  ImGui::GetIO().IniFilename = nullptr;
+  ImGui::StyleColorsDark();
+
+  // The pixels belong to the application, imx only renders into them
+  BLImage image(1280, 720, BL_FORMAT_PRGB32);
+  BLImageData target{};
+  image.getData(&target);
+  if (!imx::initialize_headless(font, target)) {
+    return 1;
+  }
+
+  // The first frames lay out the windows
+  constexpr int s_frames = 3;
+  for (int frame = 0; frame < s_frames; ++frame) {
+    if (!imx::begin_frame()) {
+      return 1;
+    }
+    ImGui::NewFrame();
+    ImGui::SetNextWindowPos(ImVec2(20, 20), ImGuiCond_Always);
+    ImGui::SetNextWindowSize(ImVec2(600, 680), ImGuiCond_Always);
+    ImGui::ShowDemoWindow();
+    ImGui::Render();
+    if (!imx::draw_frame(ImGui::GetDrawData()) || !imx::end_frame()) {
+      return 1;
+    }
+  }
+
+  if (image.writeToFile(output.c_str()) != BL_SUCCESS) {
+    fmt::print("Failed to write {}\n", output);
+    return 1;
+  }
+  fmt::print("Wrote {}\n", output);
+  ImGui::DestroyContext();
+  return 0;
+}
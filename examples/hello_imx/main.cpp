@@ -9,7 +9,6 @@
 #include <fmt/core.h>
 #include <imgui.h>
 #include <thread>
-#include <tracy/Tracy.hpp>
 
 int main() {
   std::string s_ttf_font = "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf";
@@ -26,12 +25,8 @@ int main() {
   bool show_demo_window = false;
   bool show_another_window = false;
   ImVec4 clear_color{0.F, 0.F, 0.F, 1.F};
-  BLImage &icon = imx::add_texture();
-  char const *const texture = "examples/hello_blend/blend2d_logo.png";
-  if (icon.readFromFile(texture) != BL_SUCCESS) {
-    fmt::print("Failed to load icon from {}\n", texture);
-    _exit(-1);
-  }
+  ImTextureID icon =
+      imx::load_texture_async("examples/hello_imx/blend2d_logo.png");
 
   ImGui::StyleColorsDark();
 
@@ -75,6 +70,10 @@ int main() {
         ImGui::Text("This is some useful text.");
         ImGui::Checkbox("Demo Window", &show_demo_window);
         ImGui::Checkbox("Another Window", &show_another_window);
+        static bool cost_overlay = false;
+        if (ImGui::Checkbox("Cost overlay", &cost_overlay)) {
+          imx::set_cost_overlay(cost_overlay);
+        }
 
         ImGui::SliderFloat(
             "float", &f, 0.0F,
@@ -92,8 +91,14 @@ int main() {
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS) render(%.1f)",
                     1000.0F / ImGui::GetIO().Framerate,
                     ImGui::GetIO().Framerate, fps);
-        ImGui::Image(static_cast<ImTextureID>(&icon),
-                     ImVec2(icon.size().w / 2.F, icon.size().h / 2.F));
+        // The size is unknown until the image is decoded, reserve room for
+        // the placeholder meanwhile
+        auto icon_info = imx::get_texture_info(icon);
+        auto icon_size =
+            icon_info.loading
+                ? ImVec2(128.F, 128.F)
+                : ImVec2(icon_info.width / 2.F, icon_info.height / 2.F);
+        ImGui::Image(icon, icon_size);
         ImGui::End();
       }
 
@@ -0,0 +1,405 @@
+#include "imx/imx.hpp"
+#include "imx/texture.hpp"
+#include "render.hpp"
+#include <algorithm>
+#include <array>
+#include <blend2d.h>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <imgui.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Builds ImGui scenes of configurable size, sweeps every combination of the
+// given parameters and prints the median build, conversion, raster and
+// total frame time of each as CSV, together with the shapes and glyphs imx
+// converted. Text and tables shrink their font until all of the content
+// fits its window, so ImGui does not clip it before it reaches imx.
+// Everything renders offscreen.
+//
+// imx_workload [font.ttf] [--scenes text,table,...] [--windows 1,4]
+//              [--widgets 10,100] [--glyphs 1000] [--textures 0,16]
+//              [--sizes 800x600,1920x1080] [--frames n]
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+enum class scene : std::uint8_t { text, table, frames, pickers, images };
+
+constexpr std::array<std::string_view, 5> s_scene_names{
+    "text", "table", "frames", "pickers", "images"};
+
+struct parameters {
+  scene kind;
+  int width;
+  int height;
+  int windows;
+  int widgets;
+  int glyphs;
+  int textures;
+};
+
+struct options {
+  std::string font = "/usr/share/fonts/truetype/ubuntu/Ubuntu-R.ttf";
+  std::vector<scene> scenes{scene::text, scene::table, scene::frames,
+                            scene::pickers, scene::images};
+  std::vector<int> windows{1, 4, 16};
+  std::vector<int> widgets{10, 100};
+  std::vector<int> glyphs{1000, 10000};
+  std::vector<int> textures{16};
+  std::vector<std::array<int, 2>> sizes{{800, 600}, {1920, 1080}};
+  int frames = 30;
+};
+
+struct timings {
+  double build_us;
+  double convert_us;
+  double raster_us;
+  int triangles;
+  std::size_t shapes;
+  std::size_t glyphs;
+};
+
+double elapsed_us(clock_type::time_point start, clock_type::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+double median(std::vector<double> values) {
+  if (values.empty()) {
+    return 0;
+  }
+  auto middle =
+      values.begin() + static_cast<std::ptrdiff_t>(values.size() / 2);
+  std::nth_element(values.begin(), middle, values.end());
+  return *middle;
+}
+
+// Smallest scale tried, the content of huge sweeps is clipped below it
+constexpr float s_min_font_scale = 0.05F;
+// Room left for wrapping and rounding when content is fitted
+constexpr float s_fit_margin = 0.9F;
+
+float clamp_font_scale(float scale) {
+  return std::clamp(scale * s_fit_margin, s_min_font_scale, 1.F);
+}
+
+// Characters wrapped to the window, with a font scale at which all lines
+// fit: the wrapped text covers about glyphs * advance * line height at
+// scale 1 and shrinks with the square of the scale
+void text_wall(int glyphs) {
+  constexpr std::string_view s_line =
+      "Sphinx of black quartz, judge my vow. 0123456789 The five boxing ";
+  static std::string s_text;
+  while (s_text.size() < static_cast<std::size_t>(glyphs)) {
+    s_text += s_line;
+  }
+  auto available = ImGui::GetContentRegionAvail();
+  auto advance = ImGui::CalcTextSize(s_line.data(),
+                                     s_line.data() + s_line.size())
+                     .x /
+                 static_cast<float>(s_line.size());
+  auto covered = static_cast<float>(glyphs) * advance *
+                 ImGui::GetTextLineHeight();
+  auto area = std::max(available.x * available.y, 0.F);
+  ImGui::SetWindowFontScale(clamp_font_scale(std::sqrt(area / covered)));
+  ImGui::PushTextWrapPos(0.F);
+  ImGui::TextUnformatted(s_text.data(), s_text.data() + glyphs);
+  ImGui::PopTextWrapPos();
+  ImGui::SetWindowFontScale(1.F);
+}
+
+// Rows without vertical cell padding and a font scale at which all rows
+// fit, a row is a line of text and its border
+void table(int rows) {
+  constexpr int s_columns = 6;
+  auto available = ImGui::GetContentRegionAvail();
+  auto row_height = available.y / static_cast<float>(std::max(rows, 1));
+  ImGui::SetWindowFontScale(
+      clamp_font_scale((row_height - 1.F) / ImGui::GetFontSize()));
+  ImGui::PushStyleVar(ImGuiStyleVar_CellPadding,
+                      ImVec2(ImGui::GetStyle().CellPadding.x, 0.F));
+  if (ImGui::BeginTable("table", s_columns,
+                        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    for (int row = 0; row < rows; ++row) {
+      ImGui::TableNextRow();
+      for (int column = 0; column < s_columns; ++column) {
+        ImGui::TableSetColumnIndex(column);
+        ImGui::Text("%d:%d", row, column);
+      }
+    }
+    ImGui::EndTable();
+  }
+  ImGui::PopStyleVar();
+  ImGui::SetWindowFontScale(1.F);
+}
+
+// Children nested four deep, each level holding a share of the widgets
+void nested_frames(int widgets, int depth = 0) {
+  constexpr int s_depth = 4;
+  for (int idx = 0; idx < widgets / s_depth; ++idx) {
+    ImGui::PushID(idx);
+    ImGui::Button("button");
+    ImGui::PopID();
+    if (idx % 4 != 3) {
+      ImGui::SameLine();
+    }
+  }
+  if (depth + 1 < s_depth &&
+      ImGui::BeginChild("child", ImVec2(0, 0), ImGuiChildFlags_Border)) {
+    nested_frames(widgets, depth + 1);
+  }
+  if (depth + 1 < s_depth) {
+    ImGui::EndChild();
+  }
+}
+
+void pickers(int widgets) {
+  static std::array<float, 4> s_color{0.4F, 0.7F, 0.2F, 1.F};
+  for (int idx = 0; idx < widgets; ++idx) {
+    ImGui::PushID(idx);
+    ImGui::ColorPicker4("picker", s_color.data());
+    ImGui::PopID();
+  }
+}
+
+void image_grid(std::vector<ImTextureID> const &textures) {
+  constexpr int s_per_row = 8;
+  for (std::size_t idx = 0; idx < textures.size(); ++idx) {
+    ImGui::Image(textures[idx], ImVec2(64, 64));
+    if ((idx + 1) % s_per_row != 0) {
+      ImGui::SameLine();
+    }
+  }
+}
+
+void build_scene(parameters const &params,
+                 std::vector<ImTextureID> const &textures) {
+  auto columns = static_cast<int>(
+      std::ceil(std::sqrt(static_cast<double>(params.windows))));
+  auto rows = (params.windows + columns - 1) / columns;
+  ImVec2 size(static_cast<float>(params.width) / static_cast<float>(columns),
+              static_cast<float>(params.height) / static_cast<float>(rows));
+  for (int idx = 0; idx < params.windows; ++idx) {
+    ImGui::SetNextWindowPos(
+        ImVec2(size.x * static_cast<float>(idx % columns),
+               size.y * static_cast<float>(idx / columns)),
+        ImGuiCond_Always);
+    ImGui::SetNextWindowSize(size, ImGuiCond_Always);
+    auto title = fmt::format("window {}", idx);
+    ImGui::Begin(title.c_str());
+    switch (params.kind) {
+    case scene::text:
+      text_wall(params.glyphs);
+      break;
+    case scene::table:
+      table(params.widgets);
+      break;
+    case scene::frames:
+      nested_frames(params.widgets);
+      break;
+    case scene::pickers:
+      pickers(params.widgets);
+      break;
+    case scene::images:
+      image_grid(textures);
+      break;
+    }
+    ImGui::End();
+  }
+}
+
+// Checkerboards in a different colour each, so no two textures are equal
+std::vector<ImTextureID> create_textures(int count) {
+  std::vector<ImTextureID> result;
+  for (int idx = 0; idx < count; ++idx) {
+    BLImage image(128, 128, BL_FORMAT_PRGB32);
+    BLContext ctx(image, BLContextCreateInfo{});
+    ctx.fillAll(BLRgba32(0xFF202020U));
+    ctx.setFillStyle(BLRgba32(0xFF000000U | (0x9E3779B9U * (idx + 1))));
+    for (int y = 0; y < 8; ++y) {
+      for (int x = y % 2; x < 8; x += 2) {
+        ctx.fillRect(BLRectI(x * 16, y * 16, 16, 16));
+      }
+    }
+    ctx.end();
+    result.push_back(imx::add_texture(image));
+  }
+  return result;
+}
+
+timings run(parameters const &params, int frames) {
+  auto &io = ImGui::GetIO();
+  io.DisplaySize = ImVec2(static_cast<float>(params.width),
+                          static_cast<float>(params.height));
+  auto textures =
+      create_textures(params.kind == scene::images ? params.textures : 0);
+  BLImage target(params.width, params.height, BL_FORMAT_PRGB32);
+  BLContext ctx(target, BLContextCreateInfo{});
+  imx::frame_data frame;
+  std::vector<double> build;
+  std::vector<double> convert;
+  std::vector<double> raster;
+  int triangles = 0;
+  std::size_t shapes = 0;
+  std::size_t glyphs = 0;
+  // The first frames lay out windows and fill the caches
+  constexpr int s_warmup = 3;
+  for (int idx = 0; idx < frames + s_warmup; ++idx) {
+    auto start = clock_type::now();
+    ImGui::NewFrame();
+    build_scene(params, textures);
+    ImGui::Render();
+    auto built = clock_type::now();
+    auto const *draw_data = ImGui::GetDrawData();
+    imx::convert_frame(frame, draw_data);
+    auto converted = clock_type::now();
+    imx::render_frame(ctx, frame, BLRgba32(0xFF000000U));
+    ctx.flush(BL_CONTEXT_FLUSH_SYNC);
+    auto rendered = clock_type::now();
+    if (idx >= s_warmup) {
+      build.push_back(elapsed_us(start, built));
+      convert.push_back(elapsed_us(built, converted));
+      raster.push_back(elapsed_us(converted, rendered));
+      triangles = draw_data->TotalIdxCount / 3;
+      shapes = frame.counts.shapes;
+      glyphs = frame.counts.glyphs;
+    }
+  }
+  ctx.end();
+  for (auto texture : textures) {
+    imx::remove_texture(texture);
+  }
+  return {median(build), median(convert), median(raster), triangles, shapes,
+          glyphs};
+}
+
+// Parameters a scene does not use are only run with their first value
+std::vector<int> sweep(std::vector<int> const &values, bool used) {
+  return used ? values : std::vector<int>{values.front()};
+}
+
+std::vector<int> parse_list(std::string_view text) {
+  std::vector<int> result;
+  while (!text.empty()) {
+    auto comma = text.find(',');
+    result.push_back(std::atoi(std::string(text.substr(0, comma)).c_str()));
+    text = comma == std::string_view::npos ? std::string_view{}
+                                           : text.substr(comma + 1);
+  }
+  return result;
+}
+
+bool parse(options &opts, int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    std::string_view value = i + 1 < argc ? argv[i + 1] : "";
+    if (arg == "--windows") {
+      opts.windows = parse_list(value);
+    } else if (arg == "--widgets") {
+      opts.widgets = parse_list(value);
+    } else if (arg == "--glyphs") {
+      opts.glyphs = parse_list(value);
+    } else if (arg == "--textures") {
+      opts.textures = parse_list(value);
+    } else if (arg == "--frames") {
+      opts.frames = std::atoi(std::string(value).c_str());
+    } else if (arg == "--sizes") {
+      opts.sizes.clear();
+      for (std::string_view rest = value; !rest.empty();) {
+        auto comma = rest.find(',');
+        auto item = rest.substr(0, comma);
+        auto x = item.find('x');
+        if (x == std::string_view::npos) {
+          return false;
+        }
+        opts.sizes.push_back(
+            {std::atoi(std::string(item.substr(0, x)).c_str()),
+             std::atoi(std::string(item.substr(x + 1)).c_str())});
+        rest = comma == std::string_view::npos ? std::string_view{}
+                                               : rest.substr(comma + 1);
+      }
+    } else if (arg == "--scenes") {
+      opts.scenes.clear();
+      for (std::string_view rest = value; !rest.empty();) {
+        auto comma = rest.find(',');
+        auto found = std::find(s_scene_names.begin(), s_scene_names.end(),
+                               rest.substr(0, comma));
+        if (found == s_scene_names.end()) {
+          return false;
+        }
+        opts.scenes.push_back(
+            static_cast<scene>(found - s_scene_names.begin()));
+        rest = comma == std::string_view::npos ? std::string_view{}
+                                               : rest.substr(comma + 1);
+      }
+    } else if (!arg.empty() && arg.front() != '-') {
+      opts.font = arg;
+      continue;
+    } else {
+      return false;
+    }
+    ++i;
+  }
+  return opts.frames > 0 && !opts.scenes.empty() && !opts.windows.empty() &&
+         !opts.widgets.empty() && !opts.glyphs.empty() &&
+         !opts.textures.empty() && !opts.sizes.empty();
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  options opts;
+  if (!parse(opts, argc, argv)) {
+    fmt::print("usage: imx_workload [font.ttf] [--scenes text,table,frames,"
+               "pickers,images] [--windows n,..] [--widgets n,..] "
+               "[--glyphs n,..] [--textures n,..] [--sizes WxH,..] "
+               "[--frames n]\n");
+    return 1;
+  }
+  ImGui::CreateContext();
+  ImGui::GetIO().IniFilename = nullptr;
+  ImGui::StyleColorsDark();
+  ImGui::GetStyle().ChildRounding = 8.F;
+  ImGui::GetStyle().FrameRounding = 4.F;
+  if (!imx::initialize_renderer(opts.font, ImVec4{0.F, 0.F, 0.F, 1.F}, {}, {},
+                                {})) {
+    return 1;
+  }
+
+  fmt::print("scene,width,height,windows,widgets,glyphs,textures,triangles,"
+             "shapes,converted_glyphs,frame_us,build_us,convert_us,"
+             "raster_us\n");
+  for (auto kind : opts.scenes) {
+    for (auto const &size : opts.sizes) {
+      for (auto windows : opts.windows) {
+        for (auto widgets : sweep(opts.widgets, kind != scene::text &&
+                                                    kind != scene::images)) {
+          for (auto glyphs : sweep(opts.glyphs, kind == scene::text)) {
+            for (auto textures : sweep(opts.textures, kind == scene::images)) {
+              parameters params{kind,    size[0], size[1], windows,
+                                widgets, glyphs,  textures};
+              auto result = run(params, opts.frames);
+              fmt::print("{},{},{},{},{},{},{},{},{},{},{:.1f},{:.1f},{:.1f},"
+                         "{:.1f}\n",
+                         s_scene_names[static_cast<std::size_t>(kind)],
+                         size[0], size[1], windows, widgets, glyphs, textures,
+                         result.triangles, result.shapes, result.glyphs,
+                         result.build_us + result.convert_us +
+                             result.raster_us,
+                         result.build_us, result.convert_us,
+                         result.raster_us);
+            }
+          }
+        }
+      }
+    }
+  }
+  ImGui::DestroyContext();
+  return 0;
+}
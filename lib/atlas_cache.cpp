@@ -0,0 +1,226 @@
+#include "atlas_cache.hpp"
+#include "hasher.hpp"
+#include "instrumentation.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fmt/core.h>
+#include <imgui_internal.h>
+#include <vector>
+
+namespace imx {
+
+namespace {
+
+constexpr std::uint32_t s_version = 1;
+constexpr char s_magic[4] = {'I', 'M', 'X', 'A'};
+
+// The file is only ever read back by the build that wrote it, so records
+// are stored in native layout and the key covers their sizes
+struct header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint64_t key;
+  std::int32_t width;
+  std::int32_t height;
+  std::uint32_t fonts;
+  std::uint32_t custom_rects;
+};
+
+struct font_record {
+  float ascent;
+  float descent;
+  std::int32_t config_count;
+  std::uint32_t glyphs;
+};
+
+struct rect_record {
+  std::uint16_t x;
+  std::uint16_t y;
+};
+
+// Glyphs of user defined custom rectangles are added again when the atlas
+// is finished, atlases using them are never cached
+bool has_custom_glyphs(ImFontAtlas const &atlas) {
+  return std::any_of(atlas.CustomRects.begin(), atlas.CustomRects.end(),
+                     [](auto const &rect) { return rect.Font != nullptr; });
+}
+
+std::uint64_t atlas_key(ImFontAtlas const &atlas) {
+  IMX_ZONE(stage);
+  hasher key;
+  key.add(s_version)
+      .add(IMGUI_VERSION_NUM)
+      .add(sizeof(ImFontGlyph))
+      .add(atlas.Flags)
+      .add(atlas.TexDesiredWidth)
+      .add(atlas.TexGlyphPadding)
+      .add(atlas.Fonts.Size);
+  for (auto const &config : atlas.ConfigData) {
+    key.add_bytes(config.FontData, static_cast<std::size_t>(std::max(
+                                       0, config.FontDataSize)))
+        .add(config.FontDataSize)
+        .add(config.FontNo)
+        .add(config.SizePixels)
+        .add(config.OversampleH)
+        .add(config.OversampleV)
+        .add(config.PixelSnapH)
+        .add(config.GlyphExtraSpacing)
+        .add(config.GlyphOffset)
+        .add(config.GlyphMinAdvanceX)
+        .add(config.GlyphMaxAdvanceX)
+        .add(config.MergeMode)
+        .add(config.FontBuilderFlags)
+        .add(config.RasterizerMultiply)
+        .add(config.RasterizerDensity)
+        .add(config.EllipsisChar);
+    // No ranges selects the default ranges of the ImGui version
+    for (auto const *range = config.GlyphRanges;
+         range != nullptr && *range != 0; ++range) {
+      key.add(*range);
+    }
+    key.add(ImWchar{0});
+    auto font = std::find(atlas.Fonts.begin(), atlas.Fonts.end(),
+                          config.DstFont);
+    key.add(static_cast<std::int64_t>(font - atlas.Fonts.begin()));
+  }
+  for (auto const &rect : atlas.CustomRects) {
+    key.add(rect.Width).add(rect.Height);
+  }
+  return key.value;
+}
+
+template <typename T> void append(std::vector<unsigned char> &out, T const &x) {
+  auto const *bytes = reinterpret_cast<unsigned char const *>(&x);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+} // namespace
+
+bool load_atlas_cache(ImFontAtlas &atlas, std::string const &path) {
+  IMX_ZONE(stage);
+  if (has_custom_glyphs(atlas)) {
+    return false;
+  }
+  mapped_file file(path);
+  if (file.data == nullptr) {
+    return false;
+  }
+  // Registers the mouse cursor and line rectangles the cache has positions
+  // for, building the atlas later does the same
+  ImFontAtlasBuildInit(&atlas);
+  byte_reader in{file.data, file.size};
+  header head{};
+  if (!in.read(head) || std::memcmp(head.magic, s_magic, sizeof(s_magic)) != 0 ||
+      head.version != s_version || head.width <= 0 || head.height <= 0 ||
+      head.fonts != static_cast<std::uint32_t>(atlas.Fonts.Size) ||
+      head.custom_rects != static_cast<std::uint32_t>(atlas.CustomRects.Size) ||
+      head.key != atlas_key(atlas)) {
+    return false;
+  }
+
+  // Everything is validated before the atlas is touched
+  std::vector<rect_record> rects(head.custom_rects);
+  for (auto &rect : rects) {
+    if (!in.read(rect)) {
+      return false;
+    }
+  }
+  std::vector<font_record> fonts(head.fonts);
+  std::vector<ImFontGlyph const *> glyphs(head.fonts);
+  for (std::size_t idx = 0; idx != fonts.size(); ++idx) {
+    auto const *records =
+        in.read(fonts[idx])
+            ? in.skip(sizeof(ImFontGlyph) * std::size_t{fonts[idx].glyphs})
+            : nullptr;
+    if (records == nullptr) {
+      return false;
+    }
+    glyphs[idx] = reinterpret_cast<ImFontGlyph const *>(records);
+  }
+  auto pixel_count = static_cast<std::size_t>(head.width) *
+                     static_cast<std::size_t>(head.height);
+  auto const *pixels = in.skip(pixel_count);
+  if (pixels == nullptr || in.offset != in.size) {
+    return false;
+  }
+
+  for (std::size_t idx = 0; idx != rects.size(); ++idx) {
+    atlas.CustomRects[static_cast<int>(idx)].X = rects[idx].x;
+    atlas.CustomRects[static_cast<int>(idx)].Y = rects[idx].y;
+  }
+  atlas.TexWidth = head.width;
+  atlas.TexHeight = head.height;
+  atlas.TexUvScale = ImVec2(1.F / static_cast<float>(head.width),
+                            1.F / static_cast<float>(head.height));
+  atlas.TexPixelsAlpha8 = static_cast<unsigned char *>(IM_ALLOC(pixel_count));
+  std::memcpy(atlas.TexPixelsAlpha8, pixels, pixel_count);
+  for (std::size_t idx = 0; idx != fonts.size(); ++idx) {
+    ImFont *font = atlas.Fonts[static_cast<int>(idx)];
+    auto const &record = fonts[idx];
+    ImFontAtlasBuildSetupFont(&atlas, font,
+                              const_cast<ImFontConfig *>(font->ConfigData),
+                              record.ascent, record.descent);
+    font->ConfigDataCount = static_cast<short>(record.config_count);
+    // Records are copied out as the mapping makes no alignment promises
+    for (std::uint32_t glyph_idx = 0; glyph_idx != record.glyphs;
+         ++glyph_idx) {
+      ImFontGlyph glyph{};
+      std::memcpy(&glyph, glyphs[idx] + glyph_idx, sizeof(ImFontGlyph));
+      font->AddGlyph(nullptr, static_cast<ImWchar>(glyph.Codepoint), glyph.X0,
+                     glyph.Y0, glyph.X1, glyph.Y1, glyph.U0, glyph.V0,
+                     glyph.U1, glyph.V1, glyph.AdvanceX);
+    }
+  }
+  ImFontAtlasBuildFinish(&atlas);
+  return true;
+}
+
+bool save_atlas_cache(ImFontAtlas const &atlas, std::string const &path) {
+  IMX_ZONE(stage);
+  if (atlas.TexPixelsAlpha8 == nullptr || atlas.TexPixelsUseColors ||
+      has_custom_glyphs(atlas)) {
+    return false;
+  }
+  std::vector<unsigned char> out;
+  header head{{}, s_version, atlas_key(atlas), atlas.TexWidth,
+              atlas.TexHeight, static_cast<std::uint32_t>(atlas.Fonts.Size),
+              static_cast<std::uint32_t>(atlas.CustomRects.Size)};
+  std::memcpy(head.magic, s_magic, sizeof(s_magic));
+  append(out, head);
+  for (auto const &rect : atlas.CustomRects) {
+    append(out, rect_record{rect.X, rect.Y});
+  }
+  for (ImFont const *font : atlas.Fonts) {
+    append(out, font_record{font->Ascent, font->Descent,
+                            font->ConfigDataCount,
+                            static_cast<std::uint32_t>(font->Glyphs.Size)});
+    for (auto const &glyph : font->Glyphs) {
+      append(out, glyph);
+    }
+  }
+  out.insert(out.end(), atlas.TexPixelsAlpha8,
+             atlas.TexPixelsAlpha8 + static_cast<std::size_t>(atlas.TexWidth) *
+                                         atlas.TexHeight);
+
+  // Written aside and renamed so a concurrent start never sees half a file
+  auto temporary = path + ".tmp";
+  std::FILE *file = std::fopen(temporary.c_str(), "wb");
+  if (file == nullptr) {
+    fmt::print("Failed to write font atlas cache {}\n", path);
+    return false;
+  }
+  bool written = std::fwrite(out.data(), 1, out.size(), file) == out.size();
+  written = std::fclose(file) == 0 && written;
+  if (!written || std::rename(temporary.c_str(), path.c_str()) != 0) {
+    std::remove(temporary.c_str());
+    fmt::print("Failed to write font atlas cache {}\n", path);
+    return false;
+  }
+  return true;
+}
+
+} // namespace imx
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <imgui.h>
+#include <string>
+
+namespace imx {
+
+// Persists the baked font atlas, its pixels and glyph tables, between runs.
+// The cache is keyed on the ImGui version and on everything that goes into
+// baking: the font data, sizes, glyph ranges and atlas settings. A stale or
+// damaged cache is ignored and replaced after the atlas is built.
+
+// Restores the fonts added to atlas from the cache instead of building
+// them, returns false if the cache can not be used
+bool load_atlas_cache(ImFontAtlas &atlas, std::string const &path);
+// Writes the built atlas to the cache
+bool save_atlas_cache(ImFontAtlas const &atlas, std::string const &path);
+
+} // namespace imx
@@ -0,0 +1,292 @@
+#include "capture.hpp"
+#include "instrumentation.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+
+namespace imx {
+
+namespace {
+
+constexpr std::uint32_t s_version = 1;
+constexpr char s_magic[4] = {'I', 'M', 'X', 'D'};
+// Every record and buffer starts on this boundary so buffers can be used
+// straight from the mapping
+constexpr std::size_t s_alignment = 8;
+
+struct header {
+  char magic[4];
+  std::uint32_t version;
+  std::uint32_t vertex_size;
+  std::uint32_t index_size;
+  std::int32_t atlas_width;
+  std::int32_t atlas_height;
+};
+
+struct frame_record {
+  std::uint32_t lists;
+  std::uint32_t reserved;
+  float display_pos[2];
+  float display_size[2];
+  float framebuffer_scale[2];
+  // Bytes of the lists following the record
+  std::uint64_t bytes;
+};
+
+struct list_record {
+  std::uint32_t commands;
+  std::uint32_t vertices;
+  std::uint32_t indices;
+  std::uint32_t reserved;
+};
+
+// User callbacks can not be replayed, their commands are kept so the
+// command structure stays the same but are never called
+struct command_record {
+  float clip[4];
+  std::uint64_t texture;
+  std::uint32_t vtx_offset;
+  std::uint32_t idx_offset;
+  std::uint32_t elem_count;
+  std::uint32_t callback;
+};
+
+static_assert(sizeof(header) % s_alignment == 0);
+static_assert(sizeof(frame_record) % s_alignment == 0);
+static_assert(sizeof(list_record) % s_alignment == 0);
+static_assert(sizeof(command_record) % s_alignment == 0);
+
+constexpr std::size_t padded(std::size_t bytes) {
+  return (bytes + s_alignment - 1) / s_alignment * s_alignment;
+}
+
+template <typename T> void append(std::vector<unsigned char> &out, T const &x) {
+  auto const *bytes = reinterpret_cast<unsigned char const *>(&x);
+  out.insert(out.end(), bytes, bytes + sizeof(T));
+}
+
+void append_padded(std::vector<unsigned char> &out, void const *data,
+                   std::size_t bytes) {
+  auto const *begin = static_cast<unsigned char const *>(data);
+  out.insert(out.end(), begin, begin + bytes);
+  out.resize(out.size() + padded(bytes) - bytes);
+}
+
+// Points an ImVector at memory it does not own, release must be called
+// before the vector is destroyed
+template <typename T>
+void borrow(ImVector<T> &vector, unsigned char const *data, int count) {
+  vector.Data = reinterpret_cast<T *>(const_cast<unsigned char *>(data));
+  vector.Size = count;
+  vector.Capacity = count;
+}
+
+template <typename T> void forget(ImVector<T> &vector) {
+  vector.Data = nullptr;
+  vector.Size = 0;
+  vector.Capacity = 0;
+}
+
+// The renderer walks the indices of consecutive commands and uses them to
+// index the vertices directly, so commands have to cover the index buffer
+// in order and every index has to name a vertex of the list
+bool commands_fit(ImDrawList const &list) {
+  auto vertices = static_cast<std::size_t>(list.VtxBuffer.Size);
+  auto indices = static_cast<std::size_t>(list.IdxBuffer.Size);
+  std::size_t consumed = 0;
+  for (auto const &cmd : list.CmdBuffer) {
+    if (cmd.IdxOffset != consumed || cmd.ElemCount > indices - consumed) {
+      return false;
+    }
+    for (std::size_t i = consumed; i != consumed + cmd.ElemCount; ++i) {
+      if (std::size_t{cmd.VtxOffset} + list.IdxBuffer.Data[i] >= vertices) {
+        return false;
+      }
+    }
+    consumed += cmd.ElemCount;
+  }
+  return true;
+}
+
+} // namespace
+
+capture_writer::~capture_writer() { close(); }
+
+bool capture_writer::open(std::string const &path, ImFontAtlas const &atlas) {
+  close();
+  file_ = std::fopen(path.c_str(), "wb");
+  if (file_ == nullptr) {
+    fmt::print("Failed to open capture {}\n", path);
+    return false;
+  }
+  header head{{},
+              s_version,
+              sizeof(ImDrawVert),
+              sizeof(ImDrawIdx),
+              atlas.TexWidth,
+              atlas.TexHeight};
+  std::memcpy(head.magic, s_magic, sizeof(s_magic));
+  if (std::fwrite(&head, sizeof(head), 1, file_) != 1) {
+    fmt::print("Failed to write capture {}\n", path);
+    close();
+    return false;
+  }
+  return true;
+}
+
+void capture_writer::write(ImDrawData const &draw_data) {
+  IMX_ZONE(stage);
+  if (file_ == nullptr) {
+    return;
+  }
+  buffer_.clear();
+  for (int n = 0; n < draw_data.CmdListsCount; ++n) {
+    ImDrawList const *list = draw_data.CmdLists[n];
+    append(buffer_,
+           list_record{static_cast<std::uint32_t>(list->CmdBuffer.Size),
+                       static_cast<std::uint32_t>(list->VtxBuffer.Size),
+                       static_cast<std::uint32_t>(list->IdxBuffer.Size), 0});
+    for (auto const &cmd : list->CmdBuffer) {
+      append(buffer_,
+             command_record{
+                 {cmd.ClipRect.x, cmd.ClipRect.y, cmd.ClipRect.z,
+                  cmd.ClipRect.w},
+                 static_cast<std::uint64_t>(
+                     reinterpret_cast<std::uintptr_t>(cmd.TextureId)),
+                 cmd.VtxOffset,
+                 cmd.IdxOffset,
+                 cmd.ElemCount,
+                 cmd.UserCallback != nullptr ? 1U : 0U});
+    }
+    append_padded(buffer_, list->VtxBuffer.Data,
+                  sizeof(ImDrawVert) *
+                      static_cast<std::size_t>(list->VtxBuffer.Size));
+    append_padded(buffer_, list->IdxBuffer.Data,
+                  sizeof(ImDrawIdx) *
+                      static_cast<std::size_t>(list->IdxBuffer.Size));
+  }
+  frame_record frame{static_cast<std::uint32_t>(draw_data.CmdListsCount),
+                     0,
+                     {draw_data.DisplayPos.x, draw_data.DisplayPos.y},
+                     {draw_data.DisplaySize.x, draw_data.DisplaySize.y},
+                     {draw_data.FramebufferScale.x,
+                      draw_data.FramebufferScale.y},
+                     buffer_.size()};
+  if (std::fwrite(&frame, sizeof(frame), 1, file_) != 1 ||
+      std::fwrite(buffer_.data(), 1, buffer_.size(), file_) != buffer_.size()) {
+    fmt::print("Failed to write capture, capturing stopped\n");
+    close();
+  }
+}
+
+void capture_writer::close() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+}
+
+capture_reader::capture_reader(std::string const &path)
+    : file_(path), in_{file_.data, file_.size} {
+  header head{};
+  if (file_.data == nullptr || !in_.read(head) ||
+      std::memcmp(head.magic, s_magic, sizeof(s_magic)) != 0 ||
+      head.version != s_version || head.vertex_size != sizeof(ImDrawVert) ||
+      head.index_size != sizeof(ImDrawIdx)) {
+    fmt::print("Failed to read capture {}\n", path);
+    return;
+  }
+  atlas_size_ = ImVec2(static_cast<float>(head.atlas_width),
+                       static_cast<float>(head.atlas_height));
+  first_frame_ = in_.offset;
+  valid_ = true;
+}
+
+capture_reader::~capture_reader() { release(); }
+
+void capture_reader::release() {
+  for (auto &list : lists_) {
+    forget(list->VtxBuffer);
+    forget(list->IdxBuffer);
+  }
+}
+
+void capture_reader::rewind() { in_.offset = first_frame_; }
+
+ImDrawData const *capture_reader::next() {
+  IMX_ZONE(stage);
+  frame_record frame{};
+  if (!valid_ || !in_.read(frame) || frame.bytes > in_.size - in_.offset) {
+    return nullptr;
+  }
+  auto end = in_.offset + frame.bytes;
+  // Counts come from the file and are checked against the bytes left in the
+  // frame before they size anything
+  if (sizeof(list_record) * std::size_t{frame.lists} > frame.bytes) {
+    valid_ = false;
+    return nullptr;
+  }
+  release();
+  while (lists_.size() < frame.lists) {
+    lists_.push_back(std::make_unique<ImDrawList>(nullptr));
+  }
+  draw_data_ = ImDrawData{};
+  draw_data_.Valid = true;
+  draw_data_.DisplayPos = ImVec2(frame.display_pos[0], frame.display_pos[1]);
+  draw_data_.DisplaySize =
+      ImVec2(frame.display_size[0], frame.display_size[1]);
+  draw_data_.FramebufferScale =
+      ImVec2(frame.framebuffer_scale[0], frame.framebuffer_scale[1]);
+  for (std::uint32_t n = 0; n < frame.lists; ++n) {
+    auto &list = *lists_[n];
+    list_record record{};
+    if (!in_.read(record) || in_.offset > end ||
+        sizeof(command_record) * std::size_t{record.commands} >
+            end - in_.offset) {
+      valid_ = false;
+      return nullptr;
+    }
+    list.CmdBuffer.resize(static_cast<int>(record.commands));
+    for (auto &cmd : list.CmdBuffer) {
+      command_record command{};
+      if (!in_.read(command)) {
+        valid_ = false;
+        return nullptr;
+      }
+      cmd = ImDrawCmd{};
+      cmd.ClipRect = ImVec4(command.clip[0], command.clip[1], command.clip[2],
+                            command.clip[3]);
+      cmd.TextureId = reinterpret_cast<ImTextureID>(
+          static_cast<std::uintptr_t>(command.texture));
+      cmd.VtxOffset = command.vtx_offset;
+      cmd.IdxOffset = command.idx_offset;
+      cmd.ElemCount = command.elem_count;
+    }
+    auto const *vertices =
+        in_.skip(padded(sizeof(ImDrawVert) * std::size_t{record.vertices}));
+    auto const *indices =
+        in_.skip(padded(sizeof(ImDrawIdx) * std::size_t{record.indices}));
+    if (vertices == nullptr || indices == nullptr) {
+      valid_ = false;
+      return nullptr;
+    }
+    borrow(list.VtxBuffer, vertices, static_cast<int>(record.vertices));
+    borrow(list.IdxBuffer, indices, static_cast<int>(record.indices));
+    if (!commands_fit(list)) {
+      valid_ = false;
+      return nullptr;
+    }
+    draw_data_.CmdLists.push_back(&list);
+    draw_data_.TotalVtxCount += static_cast<int>(record.vertices);
+    draw_data_.TotalIdxCount += static_cast<int>(record.indices);
+  }
+  if (in_.offset != end) {
+    valid_ = false;
+    return nullptr;
+  }
+  draw_data_.CmdListsCount = static_cast<int>(frame.lists);
+  return &draw_data_;
+}
+
+} // namespace imx
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include <cstdio>
+#include <imgui.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace imx {
+
+// Draw data of consecutive frames in a compact binary file, so frames of a
+// real application can be rendered again without it. Vertices and indices
+// are stored as ImGui lays them out and a capture is only read by builds
+// using the same ImDrawVert and ImDrawIdx. Texture ids are stored as they
+// were, textures themselves are not part of a capture.
+//
+// The font atlas size is recorded, glyphs are only recognized when the
+// replaying renderer was initialized with the same fonts.
+
+struct capture_writer {
+  capture_writer() = default;
+  ~capture_writer();
+  capture_writer(capture_writer const &) = delete;
+  capture_writer &operator=(capture_writer const &) = delete;
+
+  bool open(std::string const &path, ImFontAtlas const &atlas);
+  void write(ImDrawData const &draw_data);
+  void close();
+  [[nodiscard]] bool is_open() const { return file_ != nullptr; }
+
+private:
+  std::FILE *file_ = nullptr;
+  std::vector<unsigned char> buffer_;
+};
+
+// Reads a capture through a memory mapping. Vertex and index buffers of the
+// returned draw data point into the mapping and are valid until the next
+// frame is read.
+struct capture_reader {
+  explicit capture_reader(std::string const &path);
+  ~capture_reader();
+  capture_reader(capture_reader const &) = delete;
+  capture_reader &operator=(capture_reader const &) = delete;
+
+  [[nodiscard]] bool valid() const { return valid_; }
+  [[nodiscard]] ImVec2 atlas_size() const { return atlas_size_; }
+  // nullptr once all frames were read or the file is damaged
+  ImDrawData const *next();
+  void rewind();
+
+private:
+  void release();
+
+  mapped_file file_;
+  byte_reader in_;
+  std::size_t first_frame_ = 0;
+  bool valid_ = false;
+  ImVec2 atlas_size_{};
+  ImDrawData draw_data_{};
+  std::vector<std::unique_ptr<ImDrawList>> lists_;
+};
+
+} // namespace imx
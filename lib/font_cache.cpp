@@ -0,0 +1,76 @@
+#include "font_cache.hpp"
+#include "instrumentation.hpp"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+
+namespace imx {
+
+namespace {
+
+// Sizes are quantized to a quarter pixel so animated scales do not create
+// a font for every frame
+constexpr float s_size_steps = 4.F;
+
+} // namespace
+
+std::optional<std::uint16_t> font_cache::add(ImFontConfig const &config) {
+  IMX_ZONE(stage);
+  if (config.FontData == nullptr || config.FontDataSize <= 0) {
+    return std::nullopt;
+  }
+  // ImGui may release its copy with ClearInputData, Blend2D gets its own
+  BLArray<std::uint8_t> bytes;
+  BLFontData data;
+  face_entry entry{};
+  if (bytes.appendData(static_cast<std::uint8_t const *>(config.FontData),
+                       static_cast<std::size_t>(config.FontDataSize)) !=
+          BL_SUCCESS ||
+      data.createFromData(bytes) != BL_SUCCESS ||
+      entry.face.createFromData(data, static_cast<std::uint32_t>(
+                                          config.FontNo)) != BL_SUCCESS) {
+    fmt::print("Failed to create a font face for {}\n", config.Name);
+    return std::nullopt;
+  }
+  auto const &metrics = entry.face.designMetrics();
+  auto height = metrics.ascent + metrics.descent;
+  entry.em_per_pixel =
+      height > 0 ? static_cast<float>(metrics.unitsPerEm) / height : 1.F;
+  entry.size_pixels = config.SizePixels;
+  faces_.push_back(std::move(entry));
+  return static_cast<std::uint16_t>(faces_.size() - 1);
+}
+
+BLFont const *font_cache::get(std::uint16_t face, float scale) {
+  if (face >= faces_.size()) {
+    return nullptr;
+  }
+  auto &entry = faces_[face];
+  auto key = static_cast<std::int32_t>(std::lround(
+      entry.size_pixels * entry.em_per_pixel * scale * s_size_steps));
+  if (key <= 0) {
+    return nullptr;
+  }
+  auto found = entry.sizes.find(key);
+  if (found == entry.sizes.end()) {
+    IMX_ZONE_NAMED(stage, "create font");
+    BLFont font;
+    if (font.createFromFace(entry.face, static_cast<float>(key) /
+                                            s_size_steps) != BL_SUCCESS) {
+      return nullptr;
+    }
+    found = entry.sizes.emplace(key, std::move(font)).first;
+  }
+  return &found->second;
+}
+
+std::size_t font_cache::fonts() const {
+  std::size_t result = 0;
+  for (auto const &entry : faces_) {
+    result += entry.sizes.size();
+  }
+  return result;
+}
+
+} // namespace imx
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <imgui.h>
+#include <map>
+#include <optional>
+#include <vector>
+
+namespace imx {
+
+// Blend2D counterparts of the fonts in the ImGui font atlas. Every font
+// source, an ImFontConfig, gets a face created from the font data ImGui
+// loaded. Fonts are created on first use for each scale a face is drawn at,
+// so text scaled with FontGlobalScale or SetWindowFontScale is drawn from
+// outlines at its actual size.
+struct font_cache {
+  // Index of the face for the source, an empty optional if ImGui holds no
+  // font data for it or the data could not be read by Blend2D
+  std::optional<std::uint16_t> add(ImFontConfig const &config);
+  // Font for a face at scale times the size ImGui rasterized it at, nullptr
+  // for an unknown face. Pointers stay valid for the lifetime of the cache.
+  BLFont const *get(std::uint16_t face, float scale);
+
+  [[nodiscard]] std::size_t faces() const { return faces_.size(); }
+  [[nodiscard]] std::size_t fonts() const;
+
+private:
+  struct face_entry {
+    BLFontFace face;
+    // ImGui sizes fonts by the distance between ascender and descender
+    // while Blend2D sizes them by their em square
+    float em_per_pixel;
+    float size_pixels;
+    std::map<std::int32_t, BLFont> sizes;
+  };
+
+  std::vector<face_entry> faces_;
+};
+
+} // namespace imx
@@ -0,0 +1,195 @@
+#include "glyph_cache.hpp"
+#include "instrumentation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace imx {
+
+namespace {
+
+constexpr int s_atlas_width = 1024;
+constexpr int s_initial_height = 128;
+constexpr std::size_t s_default_budget = 4U * 1024U * 1024U;
+// Horizontal pen positions are quantized to quarter pixels
+constexpr int s_subpixel_buckets = 4;
+// Cells keep a pixel of transparent padding on each side
+constexpr int s_padding = 1;
+
+std::size_t atlas_bytes(BLImage const &atlas) {
+  return static_cast<std::size_t>(atlas.width()) *
+         static_cast<std::size_t>(atlas.height());
+}
+
+} // namespace
+
+std::size_t glyph_cache::key_hash::operator()(key const &k) const {
+  auto value = std::hash<BLFont const *>{}(k.font);
+  value ^= std::hash<float>{}(k.size) + 0x9E3779B97F4A7C15ULL + (value << 6U) +
+           (value >> 2U);
+  return value ^ ((static_cast<std::size_t>(k.c) << 8U) | k.bucket);
+}
+
+glyph_cache::glyph_cache() : budget_(s_default_budget) { clear(); }
+
+void glyph_cache::clear() {
+  commit();
+  entries_.clear();
+  shelves_.clear();
+  top_ = 0;
+  full_ = false;
+  atlas_ = BLImage(s_atlas_width, s_initial_height, BL_FORMAT_A8);
+}
+
+std::optional<glyph_mask> glyph_cache::find(BLFont const &font, ImWchar c,
+                                            BLPoint const &pt) {
+  auto x = std::floor(pt.x);
+  auto y = std::lround(pt.y);
+  auto bucket = static_cast<std::uint8_t>(std::min(
+      s_subpixel_buckets - 1,
+      static_cast<int>((pt.x - x) * static_cast<double>(s_subpixel_buckets))));
+  key k{&font, font.size(), c, bucket};
+  auto found = entries_.find(k);
+  if (found != entries_.end()) {
+    ++hits_;
+  } else {
+    ++misses_;
+    auto created = rasterize(k);
+    if (!created) {
+      return std::nullopt;
+    }
+    found = entries_.emplace(k, *created).first;
+  }
+  auto const &glyph = found->second;
+  return glyph_mask{glyph.area,
+                    BLPointI(static_cast<int>(x) + glyph.offset.x,
+                             static_cast<int>(y) + glyph.offset.y)};
+}
+
+std::optional<glyph_cache::entry> glyph_cache::rasterize(key const &k) {
+  IMX_ZONE(shape);
+  BLGlyphBuffer buffer;
+  BLTextMetrics metrics{};
+  if (buffer.setUtf16Text(&k.c, 1) != BL_SUCCESS ||
+      k.font->shape(buffer) != BL_SUCCESS ||
+      k.font->getTextMetrics(buffer, metrics) != BL_SUCCESS) {
+    return std::nullopt;
+  }
+  auto const &box = metrics.boundingBox;
+  if (box.x1 <= box.x0 || box.y1 <= box.y0) {
+    return entry{};
+  }
+  // The vertical extent of the font covers any glyph, using it for every
+  // glyph keeps the cells of a font equally tall which packs well
+  auto const &font_metrics = k.font->metrics();
+  auto left = static_cast<int>(std::floor(box.x0)) - s_padding;
+  auto right = static_cast<int>(std::ceil(box.x1)) + s_padding + 1;
+  auto top = static_cast<int>(std::floor(
+                 std::min<double>({box.y0, -box.y1, -font_metrics.ascent}))) -
+             s_padding;
+  auto bottom = static_cast<int>(std::ceil(std::max<double>(
+                    {box.y1, -box.y0, font_metrics.descent}))) +
+                s_padding;
+  auto area = allocate(right - left, bottom - top);
+  if (!area) {
+    return std::nullopt;
+  }
+  if (!writing_) {
+    writer_.begin(atlas_);
+    writer_.setCompOp(BL_COMP_OP_SRC_COPY);
+    writer_.setFillStyle(BLRgba32(0xFFFFFFFF));
+    writing_ = true;
+  }
+  BLPoint pen(area->x - left + static_cast<double>(k.bucket) /
+                                   static_cast<double>(s_subpixel_buckets),
+              area->y - top);
+  // Cells may hold stale glyphs or uninitialized memory, with SRC_COPY the
+  // glyph coverage then blends the fill against transparent black
+  writer_.fillRect(*area, BLRgba32(0));
+  writer_.clipToRect(*area);
+  writer_.fillUtf16Text(pen, *k.font, &k.c, 1);
+  writer_.restoreClipping();
+  return entry{*area, BLPointI(left, top)};
+}
+
+std::optional<BLRectI> glyph_cache::allocate(int width, int height) {
+  if (width > atlas_.width()) {
+    return std::nullopt;
+  }
+  for (auto &row : shelves_) {
+    // Rows are reused by glyphs at most a quarter shorter than the row
+    if (height <= row.height && height * 4 >= row.height * 3 &&
+        row.x + width <= atlas_.width()) {
+      BLRectI area(row.x, row.y, width, height);
+      row.x += width;
+      return area;
+    }
+  }
+  while (top_ + height > atlas_.height()) {
+    if (!grow()) {
+      full_ = true;
+      return std::nullopt;
+    }
+  }
+  shelves_.push_back(shelf{top_, height, width});
+  top_ += height;
+  return BLRectI(0, shelves_.back().y, width, height);
+}
+
+bool glyph_cache::grow() {
+  auto height = atlas_.height() * 2;
+  if (static_cast<std::size_t>(atlas_.width()) *
+          static_cast<std::size_t>(height) >
+      budget_) {
+    return false;
+  }
+  IMX_ZONE(stage);
+  commit();
+  BLImage grown(atlas_.width(), height, BL_FORMAT_A8);
+  BLContext ctx(grown, BLContextCreateInfo{});
+  ctx.setCompOp(BL_COMP_OP_SRC_COPY);
+  ctx.blitImage(BLPointI(0, 0), atlas_);
+  ctx.end();
+  atlas_ = std::move(grown);
+  return true;
+}
+
+void glyph_cache::commit() {
+  if (writing_) {
+    writer_.end();
+    writing_ = false;
+  }
+}
+
+glyph_cache_stats glyph_cache::stats() const {
+  glyph_cache_stats result{};
+  result.glyphs = entries_.size();
+  result.hits = hits_;
+  result.misses = misses_;
+  result.used_bytes = atlas_bytes(atlas_);
+  result.budget_bytes = budget_;
+  result.flushes = flushes_;
+  return result;
+}
+
+void glyph_cache::set_budget(std::size_t bytes) {
+  budget_ = std::max<std::size_t>(
+      bytes, static_cast<std::size_t>(s_atlas_width) * s_initial_height);
+  if (atlas_bytes(atlas_) > budget_) {
+    clear();
+    ++flushes_;
+  }
+}
+
+void glyph_cache::next_frame() {
+  // Glyphs that did not fit last frame get their space once the atlas
+  // is rebuilt with only the glyphs still in use
+  if (full_) {
+    clear();
+    ++flushes_;
+  }
+}
+
+} // namespace imx
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "imx/imx.hpp"
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <imgui.h>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace imx {
+
+// Where a pre-rasterized glyph is found in the glyph atlas and the screen
+// position its top left corner is drawn at
+struct glyph_mask {
+  BLRectI area;
+  BLPointI origin;
+};
+
+// Rasterizes every glyph once per font, size and horizontal subpixel offset
+// into an A8 atlas so drawing text becomes a masked fill per glyph instead
+// of rasterizing outlines. Glyphs are packed into shelves, the atlas grows
+// until it reaches the memory budget after which new glyphs are drawn from
+// their outlines and the atlas is rebuilt from scratch on the next frame.
+//
+// Glyphs are rasterized while the frame is converted, commit must be called
+// before the atlas is drawn from.
+struct glyph_cache {
+  glyph_cache();
+
+  // Mask for a glyph with its pen at pt, an empty optional when the glyph
+  // could not be cached. Glyphs without any ink have an empty area.
+  std::optional<glyph_mask> find(BLFont const &font, ImWchar c,
+                                 BLPoint const &pt);
+  void commit();
+  [[nodiscard]] BLImage const &atlas() const { return atlas_; }
+
+  // Changes whenever masks returned earlier are no longer valid
+  [[nodiscard]] std::size_t generation() const { return flushes_; }
+  [[nodiscard]] glyph_cache_stats stats() const;
+  void set_budget(std::size_t bytes);
+  void next_frame();
+
+private:
+  struct key {
+    BLFont const *font;
+    float size;
+    ImWchar c;
+    std::uint8_t bucket;
+
+    bool operator==(key const &other) const {
+      return font == other.font && size == other.size && c == other.c &&
+             bucket == other.bucket;
+    }
+  };
+
+  struct key_hash {
+    std::size_t operator()(key const &k) const;
+  };
+
+  // Offset is the position of the cell relative to the pen rounded down to
+  // whole pixels
+  struct entry {
+    BLRectI area;
+    BLPointI offset;
+  };
+
+  struct shelf {
+    int y;
+    int height;
+    int x;
+  };
+
+  std::optional<entry> rasterize(key const &k);
+  std::optional<BLRectI> allocate(int width, int height);
+  bool grow();
+  void clear();
+
+  std::unordered_map<key, entry, key_hash> entries_;
+  std::vector<shelf> shelves_;
+  int top_ = 0;
+  BLImage atlas_;
+  BLContext writer_;
+  bool writing_ = false;
+  bool full_ = false;
+  std::size_t budget_;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+  std::size_t flushes_ = 0;
+};
+
+} // namespace imx
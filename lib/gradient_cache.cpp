@@ -0,0 +1,155 @@
+#include "gradient_cache.hpp"
+#include "hasher.hpp"
+#include "instrumentation.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace imx {
+
+namespace {
+
+constexpr std::uint64_t s_max_age = 4;
+constexpr double s_max_shaded_size = 256;
+
+template <typename Map> void prune(Map &map, std::uint64_t frame) {
+  for (auto it = map.begin(); it != map.end();) {
+    if (it->second.last_used + s_max_age < frame) {
+      it = map.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Straight alpha interpolation like a GPU would do for vertex colours, the
+// result is premultiplied for the PRGB32 image
+std::uint32_t interpolate(std::array<BLRgba32, 3> const &colors, double w0,
+                          double w1, double w2) {
+  auto channel = [&](auto get) {
+    return w0 * get(colors[0]) + w1 * get(colors[1]) + w2 * get(colors[2]);
+  };
+  double a = channel([](BLRgba32 c) { return double(c.a()); });
+  double r = channel([](BLRgba32 c) { return double(c.r()); }) * a / 255.0;
+  double g = channel([](BLRgba32 c) { return double(c.g()); }) * a / 255.0;
+  double b = channel([](BLRgba32 c) { return double(c.b()); }) * a / 255.0;
+  auto pack = [](double x) {
+    return static_cast<std::uint32_t>(std::clamp(std::lround(x), 0L, 255L));
+  };
+  return (pack(a) << 24U) | (pack(r) << 16U) | (pack(g) << 8U) | pack(b);
+}
+
+BLImage shade(std::array<BLPoint, 3> const &points,
+              std::array<BLRgba32, 3> const &colors, double scale) {
+  IMX_ZONE(shape);
+  double max_x = 0;
+  double max_y = 0;
+  for (auto const &pt : points) {
+    max_x = std::max(max_x, pt.x);
+    max_y = std::max(max_y, pt.y);
+  }
+  auto width = std::max(1, static_cast<int>(std::ceil(max_x * scale)));
+  auto height = std::max(1, static_cast<int>(std::ceil(max_y * scale)));
+  BLImage image(width, height, BL_FORMAT_PRGB32);
+  BLImageData data{};
+  if (image.makeMutable(&data) != BL_SUCCESS) {
+    return image;
+  }
+  auto const &p0 = points[0];
+  auto const &p1 = points[1];
+  auto const &p2 = points[2];
+  double det = (p1.y - p2.y) * (p0.x - p2.x) + (p2.x - p1.x) * (p0.y - p2.y);
+  if (std::fabs(det) < 1e-9) {
+    return image;
+  }
+  // Barycentric weights are clamped so the pixels just outside the edges,
+  // which the anti aliased polygon fill still touches, get the edge colour
+  for (int y = 0; y != height; ++y) {
+    auto *row = reinterpret_cast<std::uint32_t *>(
+        static_cast<unsigned char *>(data.pixelData) + y * data.stride);
+    double py = (y + 0.5) / scale;
+    for (int x = 0; x != width; ++x) {
+      double px = (x + 0.5) / scale;
+      double w0 =
+          ((p1.y - p2.y) * (px - p2.x) + (p2.x - p1.x) * (py - p2.y)) / det;
+      double w1 =
+          ((p2.y - p0.y) * (px - p2.x) + (p0.x - p2.x) * (py - p2.y)) / det;
+      w0 = std::clamp(w0, 0.0, 1.0);
+      w1 = std::clamp(w1, 0.0, 1.0 - w0);
+      row[x] = interpolate(colors, w0, w1, 1.0 - w0 - w1);
+    }
+  }
+  return image;
+}
+
+} // namespace
+
+BLGradient const &gradient_cache::linear(BLPoint const &from,
+                                         BLPoint const &to,
+                                         BLRgba32 from_color,
+                                         BLRgba32 to_color) {
+  auto key = hasher{}
+                 .add(from.x)
+                 .add(from.y)
+                 .add(to.x)
+                 .add(to.y)
+                 .add(from_color.value)
+                 .add(to_color.value)
+                 .value;
+  auto found = linear_.find(key);
+  if (found == linear_.end()) {
+    BLGradient gradient(BLLinearGradientValues(from.x, from.y, to.x, to.y));
+    gradient.addStop(0.0, from_color);
+    gradient.addStop(1.0, to_color);
+    found = linear_.emplace(key, cached<BLGradient>{gradient, frame_}).first;
+  }
+  found->second.last_used = frame_;
+  return found->second.value;
+}
+
+BLImage const &gradient_cache::shaded(std::array<BLPoint, 3> const &points,
+                                      std::array<BLRgba32, 3> const &colors,
+                                      double &scale) {
+  // Vertex colour interpolation is smooth so large triangles are shaded at a
+  // reduced resolution and enlarged by the pattern
+  double extent = 0;
+  for (auto const &pt : points) {
+    extent = std::max({extent, pt.x, pt.y});
+  }
+  scale = extent > s_max_shaded_size ? s_max_shaded_size / extent : 1.0;
+  hasher key;
+  for (auto idx = 0UL; idx != points.size(); ++idx) {
+    key.add(points[idx].x).add(points[idx].y).add(colors[idx].value);
+  }
+  auto found = shaded_.find(key.value);
+  if (found == shaded_.end()) {
+    found = shaded_
+                .emplace(key.value,
+                         cached<BLImage>{shade(points, colors, scale), frame_})
+                .first;
+  }
+  found->second.last_used = frame_;
+  return found->second.value;
+}
+
+std::size_t gradient_cache::bytes() const {
+  // Two stops each, stored out of line by Blend2D
+  static constexpr std::size_t s_gradient_bytes = 2 * sizeof(BLGradientStop);
+  std::size_t result = linear_.size() * (sizeof(*linear_.begin()) +
+                                         s_gradient_bytes);
+  for (auto const &[key, image] : shaded_) {
+    result += sizeof(*shaded_.begin()) +
+              static_cast<std::size_t>(image.value.width()) *
+                  static_cast<std::size_t>(image.value.height()) * 4U;
+  }
+  return result;
+}
+
+void gradient_cache::next_frame() {
+  ++frame_;
+  prune(linear_, frame_);
+  prune(shaded_, frame_);
+}
+
+} // namespace imx
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace imx {
+
+// Keeps the gradient styles used for vertex coloured geometry alive across
+// frames. ImGui rebuilds identical gradients every frame (color pickers,
+// AddRectFilledMultiColor) so after the first frame these become lookups.
+// Entries are keyed on a hash of their geometry and colours and are dropped
+// when they have not been used for a few frames.
+struct gradient_cache {
+  BLGradient const &linear(BLPoint const &from, BLPoint const &to,
+                           BLRgba32 from_color, BLRgba32 to_color);
+  // Image of a triangle with interpolated vertex colours, points are relative
+  // to the top left corner of the triangle bounds. The image may be smaller
+  // than the bounds, scale is set to the factor it must be enlarged by.
+  BLImage const &shaded(std::array<BLPoint, 3> const &points,
+                        std::array<BLRgba32, 3> const &colors, double &scale);
+
+  void next_frame();
+  // Approximate memory held by cached gradients and shaded images
+  [[nodiscard]] std::size_t bytes() const;
+
+private:
+  template <typename T> struct cached {
+    T value;
+    std::uint64_t last_used = 0;
+  };
+
+  std::unordered_map<std::uint64_t, cached<BLGradient>> linear_;
+  std::unordered_map<std::uint64_t, cached<BLImage>> shaded_;
+  std::uint64_t frame_ = 0;
+};
+
+} // namespace imx
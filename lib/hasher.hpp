@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace imx {
+
+// FNV-1a over the bytes of trivially copyable values, used to key caches
+// on the content of what is drawn
+struct hasher {
+  std::uint64_t value = 14695981039346656037ULL;
+
+  template <typename T> hasher &add(T const &item) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    unsigned char bytes[sizeof(T)];
+    std::memcpy(bytes, &item, sizeof(T));
+    for (auto byte : bytes) {
+      value = (value ^ byte) * 1099511628211ULL;
+    }
+    return *this;
+  }
+
+  hasher &add_bytes(void const *data, std::size_t size) {
+    auto const *bytes = static_cast<unsigned char const *>(data);
+    for (std::size_t idx = 0; idx != size; ++idx) {
+      value = (value ^ bytes[idx]) * 1099511628211ULL;
+    }
+    return *this;
+  }
+};
+
+} // namespace imx
@@ -0,0 +1,36 @@
+#include "imx/imx.hpp"
+#include "platform.hpp"
+#include <cstdint>
+#include <fmt/core.h>
+
+namespace imx {
+
+// Platform of builds without X11. There are no windows, frames are only
+// rendered into the target given to initialize_headless or
+// set_render_target.
+
+bool initialize_platform(renderer_options const & /*options*/) {
+  return true;
+}
+
+void update_windows(std::function<void(void const *)> const & /*release*/) {}
+
+std::optional<BLImageData> window_target() { return std::nullopt; }
+
+std::optional<double> take_present_time() { return std::nullopt; }
+
+void frame_converted() {}
+
+input_latency get_input_latency() { return {}; }
+
+bool create_window(std::uint32_t /*width*/, std::uint32_t /*height*/,
+                   std::uint32_t /*depth*/) {
+  fmt::print("imx was built without X11, windows are not available\n");
+  return false;
+}
+
+bool poll_events(BLContextFlushFlags /*flags*/) { return false; }
+
+bool enqueue_expose() { return false; }
+
+} // namespace imx
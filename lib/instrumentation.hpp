@@ -0,0 +1,72 @@
+#pragma once
+
+// Tracy instrumentation compiled into imx, chosen with the
+// INSTRUMENTATION_LEVEL CMake option. Each level adds to the one before:
+// frame marks frames, the public entry points and window system events,
+// stage times the conversion and raster stages and the caches, shape adds
+// zones for every draw list, command, glyph and shape. Zones above the
+// configured level are constant inactive and compile away, with the level
+// off Tracy is neither included nor linked.
+
+#ifndef IMX_INSTRUMENTATION_LEVEL
+#define IMX_INSTRUMENTATION_LEVEL 0
+#endif
+
+#include <cstddef>
+
+namespace imx {
+
+enum class instrumentation : int { off, frame, stage, shape };
+
+constexpr bool instrumented(instrumentation level) {
+  return level != instrumentation::off &&
+         static_cast<int>(level) <= IMX_INSTRUMENTATION_LEVEL;
+}
+
+} // namespace imx
+
+#if IMX_INSTRUMENTATION_LEVEL > 0
+#include <tracy/Tracy.hpp>
+#define IMX_ZONE(level)                                                        \
+  ZoneNamed(imx_zone, ::imx::instrumented(::imx::instrumentation::level))
+#define IMX_ZONE_NAMED(level, name)                                            \
+  ZoneNamedN(imx_zone, name,                                                   \
+             ::imx::instrumented(::imx::instrumentation::level))
+#define IMX_ZONE_VALUE(value) ZoneValueV(imx_zone, value)
+#define IMX_FRAME_MARK FrameMark
+#define IMX_MESSAGE(text) TracyMessageL(text)
+#define IMX_PLOT(name, value) TracyPlot(name, static_cast<int64_t>(value))
+#define IMX_FRAME_IMAGE(pixels, width, height)                                 \
+  FrameImage(pixels, width, height, 0, false)
+#else
+#define IMX_ZONE(level)
+#define IMX_ZONE_NAMED(level, name)
+#define IMX_ZONE_VALUE(value)
+#define IMX_FRAME_MARK
+#define IMX_MESSAGE(text)
+#define IMX_PLOT(name, value)
+#define IMX_FRAME_IMAGE(pixels, width, height)
+#endif
+
+namespace imx {
+
+// Shows memory held by owner in Tracy's memory view, in the pool of the given
+// name. Memory is reported as one allocation per owner that is freed and
+// allocated again whenever its size changes, tracked from the stage level.
+inline void track_memory([[maybe_unused]] void const *owner,
+                         [[maybe_unused]] std::size_t before,
+                         [[maybe_unused]] std::size_t after,
+                         [[maybe_unused]] char const *pool) {
+#if IMX_INSTRUMENTATION_LEVEL > 0
+  if constexpr (instrumented(instrumentation::stage)) {
+    if (before != 0) {
+      TracyFreeN(owner, pool);
+    }
+    if (after != 0) {
+      TracyAllocN(owner, after, pool);
+    }
+  }
+#endif
+}
+
+} // namespace imx
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace imx {
+
+// Read only mapping of a whole file, data is nullptr if it could not be
+// mapped or is empty
+struct mapped_file {
+  explicit mapped_file(std::string const &path) {
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+      return;
+    }
+    struct stat info {};
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+      auto length = static_cast<std::size_t>(info.st_size);
+      void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+      if (mapping != MAP_FAILED) {
+        data = static_cast<unsigned char const *>(mapping);
+        size = length;
+      }
+    }
+    close(file);
+  }
+  ~mapped_file() {
+    if (data != nullptr) {
+      munmap(const_cast<unsigned char *>(data), size);
+    }
+  }
+  mapped_file(mapped_file const &) = delete;
+  mapped_file &operator=(mapped_file const &) = delete;
+
+  unsigned char const *data = nullptr;
+  std::size_t size = 0;
+};
+
+// Bounds checked cursor over mapped bytes
+struct byte_reader {
+  unsigned char const *data;
+  std::size_t size;
+  std::size_t offset = 0;
+
+  template <typename T> bool read(T &value) {
+    return read_bytes(&value, sizeof(T));
+  }
+
+  bool read_bytes(void *output, std::size_t count) {
+    if (count > size - offset) {
+      return false;
+    }
+    std::memcpy(output, data + offset, count);
+    offset += count;
+    return true;
+  }
+
+  unsigned char const *skip(std::size_t count) {
+    if (count > size - offset) {
+      return nullptr;
+    }
+    auto const *result = data + offset;
+    offset += count;
+    return result;
+  }
+};
+
+} // namespace imx
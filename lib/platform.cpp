@@ -1,5 +1,8 @@
 #include "imx/context.hpp"
 #include "imx/imx.hpp"
+#include "instrumentation.hpp"
+#include "platform.hpp"
+#include "timing_history.hpp"
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -8,20 +11,87 @@
 #include <X11/extensions/XShm.h>
 #include <X11/extensions/shm.h>
 #include <X11/keysym.h>
+#include <algorithm>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <fmt/core.h>
+#include <fstream>
 #include <functional>
 #include <imgui.h>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <string>
 #include <sys/ipc.h>
 #include <sys/sem.h>
 #include <sys/shm.h>
-#include <tracy/Tracy.hpp>
+#include <utility>
 
 namespace imx {
 
+namespace {
+
+// Follows input through the frames until it is on screen. Input events
+// carry the X server time in milliseconds, offset maps it onto the local
+// clock using the smallest difference seen, which belongs to the event that
+// was delivered fastest. Every stage keeps its earliest input so a frame is
+// measured from the first event it responds to.
+struct latency_tracker {
+  std::optional<std::int64_t> offset;
+  std::optional<clock_type::time_point> pending;
+  std::optional<clock_type::time_point> submitted;
+  std::optional<clock_type::time_point> presenting;
+  timing_history history;
+  input_latency stats;
+};
+latency_tracker g_latency{};
+
+void keep_earliest(std::optional<clock_type::time_point> &slot,
+                   clock_type::time_point time) {
+  if (!slot || time < *slot) {
+    slot = time;
+  }
+}
+
+void record_input(Time server_time) {
+  // A server clock that restarted or wrapped around moves the offset for
+  // good, events are never delivered a second late otherwise
+  static constexpr std::int64_t s_resync_ms = 1000;
+  auto now = clock_type::now();
+  auto local_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      now.time_since_epoch())
+                      .count();
+  auto offset = local_ms - static_cast<std::int64_t>(server_time);
+  auto &known = g_latency.offset;
+  if (!known || offset < *known || offset - *known > s_resync_ms) {
+    known = offset;
+  }
+  auto received = clock_type::time_point(std::chrono::milliseconds(
+      static_cast<std::int64_t>(server_time) + *known));
+  keep_earliest(g_latency.pending, std::min(received, now));
+}
+
+void record_presented() {
+  if (!g_latency.presenting) {
+    return;
+  }
+  auto us = elapsed_us(*g_latency.presenting, clock_type::now());
+  g_latency.presenting.reset();
+  auto &stats = g_latency.stats;
+  ++stats.samples;
+  stats.last_us = us;
+  auto bucket =
+      std::min(static_cast<std::size_t>(us / input_latency::bucket_us),
+               stats.histogram.size() - 1);
+  ++stats.histogram[bucket];
+  g_latency.history.add(us);
+  IMX_PLOT("imx input latency us", us);
+}
+
+} // namespace
+
 // Function to find a 32-bit ARGB visual
 Visual *find_argb_visual(Display *display, int screen) {
   XVisualInfo visualInfoTemplate{};
@@ -49,36 +119,95 @@ template <typename T> constexpr T sanitize_width(T x) {
   return (tmp + tmp % 2) * 2;
 }
 
-Image::Image(Display *display, Visual *visual, int width, int height, int depth)
+// Size of the default huge page, 0 if the kernel has none configured
+std::size_t huge_page_size() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  std::size_t value = 0;
+  while (meminfo >> key >> value) {
+    if (key == "Hugepagesize:") {
+      return value * 1024;
+    }
+    meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+// Huge pages need a reserved pool, without one the segment falls back to
+// regular pages
+int create_segment(std::size_t size, bool huge_pages) {
+#ifdef SHM_HUGETLB
+  if (huge_pages) {
+    if (auto page = huge_page_size(); page != 0) {
+      auto rounded = (size + page - 1) / page * page;
+      auto id = shmget(IPC_PRIVATE, rounded, IPC_CREAT | SHM_HUGETLB | 0600);
+      if (id != -1) {
+        return id;
+      }
+    }
+    // Segments are recreated on every resize, report the fallback once
+    static bool reported = false;
+    if (!reported) {
+      fmt::print("Huge pages unavailable, using regular pages\n");
+      reported = true;
+    }
+  }
+#else
+  (void)huge_pages;
+#endif
+  return shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+}
+
+Image::Image(Display *display, Visual *visual, int width, int height, int depth,
+             bool huge_pages)
     : display_(display), visual_(visual), width_(sanitize_width(width)),
-      height_(height), depth_(depth), stride_(width_ * 4) {
+      height_(height), depth_(depth) {
   memset(&info_, 0, sizeof(XShmSegmentInfo));
-  info_.shmid = shmget(IPC_PRIVATE,
-                       static_cast<unsigned long>(width_) * height_ *
-                           (depth_ / sizeof(std::uint8_t)),
-                       IPC_CREAT | 0600);
-  info_.shmaddr = (char *)shmat(info_.shmid, nullptr, IPC_CREAT | 0600);
+  // The image is created first so the segment matches its actual layout
+  image_ = std::unique_ptr<XImage, void (*)(XImage *)>(
+      XShmCreateImage(display_, visual_, depth_, ZPixmap, nullptr, &info_,
+                      width_, height_),
+      [](XImage *owned) { XDestroyImage(owned); });
+  if (!image_) {
+    fmt::print("Failed to create shared memory image\n");
+    return;
+  }
+  stride_ = image_->bytes_per_line;
+  auto size = static_cast<std::size_t>(image_->bytes_per_line) *
+              static_cast<std::size_t>(image_->height);
+  info_.shmid = create_segment(size, huge_pages);
+  if (info_.shmid == -1) {
+    fmt::print("Failed to create shared memory\n");
+    memset(&info_, 0, sizeof(XShmSegmentInfo));
+    return;
+  }
+  auto *address = shmat(info_.shmid, nullptr, 0);
+  if (address == reinterpret_cast<void *>(-1)) {
+    fmt::print("Failed to map shared memory\n");
+    shmctl(info_.shmid, IPC_RMID, nullptr);
+    memset(&info_, 0, sizeof(XShmSegmentInfo));
+    return;
+  }
+  info_.shmaddr = static_cast<char *>(address);
   info_.readOnly = False;
+  image_->data = info_.shmaddr;
 
   // Attach the segment to the display
   if (XShmAttach(display_, &info_) == 0) {
     fmt::print("Failed to attach shared memory\n");
+    shmdt(info_.shmaddr);
+    shmctl(info_.shmid, IPC_RMID, nullptr);
+    image_->data = nullptr;
     memset(&info_, 0, sizeof(XShmSegmentInfo));
   }
-  image_ = std::unique_ptr<XImage, void (*)(XImage *)>(
-      XShmCreateImage(display_, visual_, depth_, ZPixmap, info_.shmaddr, &info_,
-                      width_, height_),
-      [](XImage *owned) { XDestroyImage(owned); });
   XSync(display_, 0);
-
-  // Create an XImage using the shared memory
 }
 Image::~Image() {
   if (info_.shmaddr != 0) {
     XShmDetach(display_, &info_);
-    //   XFreePixmap(display_, pixmap_);
-    shmctl(info_.shmid, IPC_RMID, nullptr);
     XSync(display_, 0);
+    shmdt(info_.shmaddr);
+    shmctl(info_.shmid, IPC_RMID, nullptr);
   }
 }
 
@@ -114,9 +243,79 @@ imx_context::imx_context()
   }
 }
 
+bool initialize_platform(renderer_options const &options) {
+  static std::unique_ptr<imx_context> s_context;
+  if (s_context) {
+    fmt::print("ImX context already initialized\n");
+    return false;
+  }
+  s_context = std::make_unique<imx_context>();
+  s_context->huge_pages = options.framebuffer_huge_pages;
+  ImGui::GetIO().BackendPlatformUserData = s_context.get();
+  return true;
+}
+
+void update_windows(std::function<void(void const *)> const &release) {
+  if (auto *context =
+          static_cast<imx_context *>(ImGui::GetIO().BackendPlatformUserData)) {
+    XSync(context->display.get(), False);
+    for (auto &window : context->windows) {
+      if (window.size_updates[0] != std::numeric_limits<int>::max()) {
+        auto width = std::numeric_limits<int>::max();
+        auto height = width;
+        std::swap(window.size_updates[0], width);
+        std::swap(window.size_updates[1], height);
+        // The renderer lets go of the old pixels before the segment is gone
+        release(window.image->data());
+        window.image = std::make_unique<Image>(
+            context->display.get(), context->visual, width, height,
+            window.image->depth(), context->huge_pages);
+        ImGui::GetIO().DisplaySize = ImVec2(width, height);
+      }
+    }
+  }
+}
+
+std::optional<BLImageData> window_target() {
+  auto *context =
+      static_cast<imx_context *>(ImGui::GetIO().BackendPlatformUserData);
+  if (context == nullptr || context->windows.empty()) {
+    return std::nullopt;
+  }
+  auto &image = *context->windows.front().image;
+  BLImageData target{};
+  target.pixelData = image.data();
+  target.size = BLSizeI(image.width(), image.height());
+  target.stride = image.stride();
+  target.format = BL_FORMAT_PRGB32;
+  return target;
+}
+
+void frame_converted() {
+  if (g_latency.pending) {
+    keep_earliest(g_latency.submitted, *g_latency.pending);
+    g_latency.pending.reset();
+  }
+}
+
+input_latency get_input_latency() {
+  auto result = g_latency.stats;
+  result.percentiles = g_latency.history.percentiles();
+  return result;
+}
+
+std::optional<double> take_present_time() {
+  auto *context =
+      static_cast<imx_context *>(ImGui::GetIO().BackendPlatformUserData);
+  if (context == nullptr) {
+    return std::nullopt;
+  }
+  return std::exchange(context->present_us, std::nullopt);
+}
+
 bool create_window(std::uint32_t width, std::uint32_t height,
                    std::uint32_t depth) {
-  ZoneScoped;
+  IMX_ZONE(frame);
   if (auto *context =
           static_cast<imx_context *>(ImGui::GetIO().BackendPlatformUserData)) {
     XSetWindowAttributes attrs;
@@ -147,7 +346,7 @@ bool create_window(std::uint32_t width, std::uint32_t height,
               XFreeGC(display_, owned);
             }),
         std::make_unique<Image>(context->display.get(), context->visual, width,
-                                height, depth),
+                                height, depth, context->huge_pages),
         unique_input_context(xic, [](_XIC *owned) { XDestroyIC(owned); })});
 
     return true;
@@ -157,7 +356,7 @@ bool create_window(std::uint32_t width, std::uint32_t height,
 
 // Function to translate X11 key codes to ImGui key codes
 ImGuiKey translate_key(XKeyEvent &event) {
-  ZoneScoped;
+  IMX_ZONE(frame);
   KeySym keysym = XLookupKeysym(&event, 0);
   if ((event.state & ShiftMask) != 0U) {
     keysym = XLookupKeysym(&event, 1);
@@ -523,7 +722,7 @@ ImGuiKey translate_key(XKeyEvent &event) {
 }
 
 bool poll_events(BLContextFlushFlags flags) {
-  ZoneScoped;
+  IMX_ZONE(frame);
   bool processed_events = false;
   if (auto *context =
           static_cast<imx_context *>(ImGui::GetIO().BackendPlatformUserData)) {
@@ -535,30 +734,32 @@ bool poll_events(BLContextFlushFlags flags) {
       if (event.type != ShmCompletionEvent) {
         switch (event.type) {
         case FocusIn: {
-          TracyMessage("X11:FocusIn", 11);
+          IMX_MESSAGE("X11:FocusIn");
           auto &io = ImGui::GetIO();
           io.AddFocusEvent(true);
           processed_events = true;
           break;
         }
         case FocusOut: {
-          TracyMessage("X11:FocusOut", 12);
+          IMX_MESSAGE("X11:FocusOut");
           auto &io = ImGui::GetIO();
           io.AddFocusEvent(false);
           processed_events = true;
           break;
         }
         case MotionNotify: {
-          TracyMessage("X11:MotionNotify", 16);
+          IMX_MESSAGE("X11:MotionNotify");
           XMotionEvent motion_event = event.xmotion;
+          record_input(motion_event.time);
           ImGuiIO &io = ImGui::GetIO();
           io.AddMousePosEvent((float)motion_event.x, (float)motion_event.y);
           processed_events = true;
           break;
         }
         case ButtonPress: {
-          TracyMessage("X11:ButtonPress", 15);
+          IMX_MESSAGE("X11:ButtonPress");
           XButtonPressedEvent press_event = event.xbutton;
+          record_input(press_event.time);
           ImGuiIO &io = ImGui::GetIO();
           switch (press_event.button) {
           case Button1: {
@@ -593,8 +794,9 @@ bool poll_events(BLContextFlushFlags flags) {
           break;
         }
         case ButtonRelease: {
-          TracyMessage("X11:ButtonRelease", 17);
+          IMX_MESSAGE("X11:ButtonRelease");
           XButtonPressedEvent press_event = event.xbutton;
+          record_input(press_event.time);
           ImGuiIO &io = ImGui::GetIO();
           switch (press_event.button) {
           case Button1: {
@@ -618,8 +820,9 @@ bool poll_events(BLContextFlushFlags flags) {
           break;
         }
         case KeyPress: {
-          TracyMessage("X11:KeyPress", 12);
+          IMX_MESSAGE("X11:KeyPress");
           XKeyEvent press_event = event.xkey;
+          record_input(press_event.time);
           ImGuiIO &io = ImGui::GetIO();
           auto found =
               std::find_if(context->windows.begin(), context->windows.end(),
@@ -645,15 +848,16 @@ bool poll_events(BLContextFlushFlags flags) {
           break;
         }
         case KeyRelease: {
-          TracyMessage("X11:KeyRelease", 14);
+          IMX_MESSAGE("X11:KeyRelease");
           XKeyEvent press_event = event.xkey;
+          record_input(press_event.time);
           ImGuiIO &io = ImGui::GetIO();
           io.AddKeyEvent(translate_key(press_event), false);
           processed_events = true;
           break;
         }
         case ConfigureNotify: {
-          TracyMessage("X11:ConfigureNotify", 19);
+          IMX_MESSAGE("X11:ConfigureNotify");
           XConfigureEvent configure_event = event.xconfigure;
           auto found =
               std::find_if(context->windows.begin(), context->windows.end(),
@@ -672,7 +876,7 @@ bool poll_events(BLContextFlushFlags flags) {
           break;
         }
         case Expose: {
-          TracyMessage("X11:Expose", 10);
+          IMX_MESSAGE("X11:Expose");
           XExposeEvent expose_event = event.xexpose;
           auto found =
               std::find_if(context->windows.begin(), context->windows.end(),
@@ -683,6 +887,11 @@ bool poll_events(BLContextFlushFlags flags) {
             imx::end_frame(flags);
             imx_window &window = *found;
             auto *image_data = window.image->image();
+            context->present_start = std::chrono::steady_clock::now();
+            if (g_latency.submitted) {
+              keep_earliest(g_latency.presenting, *g_latency.submitted);
+              g_latency.submitted.reset();
+            }
             XShmPutImage(context->display.get(), window.window, window.gc.get(),
                          image_data, 0, 0, 0, 0, image_data->width,
                          image_data->height, True);
@@ -694,8 +903,13 @@ bool poll_events(BLContextFlushFlags flags) {
           break;
         }
       } else {
-        TracyMessage("X11:ShmCompleted", 16);
-        FrameMark;
+        IMX_MESSAGE("X11:ShmCompleted");
+        IMX_FRAME_MARK;
+        context->present_us = std::chrono::duration<double, std::micro>(
+                                  std::chrono::steady_clock::now() -
+                                  context->present_start)
+                                  .count();
+        record_presented();
         imx::begin_frame();
         processed_events = true;
       }
@@ -705,7 +919,7 @@ bool poll_events(BLContextFlushFlags flags) {
 }
 
 bool enqueue_expose() {
-  ZoneScoped;
+  IMX_ZONE(frame);
   if (auto *context =
           static_cast<imx_context *>(ImGui::GetIO().BackendPlatformUserData)) {
     for (auto const &handle : context->windows) {
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "imx/imx.hpp"
+#include <blend2d.h>
+#include <functional>
+#include <optional>
+
+namespace imx {
+
+// What the renderer needs from the window system. platform.cpp implements
+// it on X11, headless.cpp when imx is built without a display server.
+
+bool initialize_platform(renderer_options const &options);
+// Applies window resizes reported since the last frame. release is called
+// with the pixels of a window image right before they are freed.
+void update_windows(std::function<void(void const *)> const &release);
+// Pixels of the window frames are rendered into, nullopt without a window
+std::optional<BLImageData> window_target();
+// Marks the input received so far as part of the frame being converted
+void frame_converted();
+// Microseconds between handing the last frame to the window system and it
+// being presented, once per presented frame and nullopt otherwise
+std::optional<double> take_present_time();
+
+} // namespace imx
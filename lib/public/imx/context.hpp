@@ -1,20 +1,24 @@
 #pragma once
 
 #include "imx/api.hpp"
+#include "imx/imx.hpp"
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <X11/extensions/XShm.h>
 #include <blend2d.h>
+#include <chrono>
 #include <functional>
 #include <imgui.h>
 #include <limits>
 #include <memory>
+#include <optional>
 
 namespace imx {
 
 struct IMX_API Image {
+  // huge_pages backs the pixels with huge pages when the kernel has them
   IMX_API Image(Display *display, Visual *visual, int width, int height,
-                int depth);
+                int depth, bool huge_pages = false);
   IMX_API ~Image();
   IMX_API Image(Image const &) = delete;
   IMX_API Image &operator=(Image const &) = delete;
@@ -65,14 +69,15 @@ struct IMX_API imx_context {
   Colormap colormap = 0;
   unique_input_method input_method;
   std::vector<imx_window> windows;
+  bool huge_pages = false;
+  // Time the last frame was handed to the X server and how long it took to
+  // be presented, taken by the renderer at the start of the next frame
+  std::chrono::steady_clock::time_point present_start{};
+  std::optional<double> present_us;
 
   imx_context();
 };
 
 IMX_API ImGuiKey translate_key(XKeyEvent &event);
-IMX_API BLImage &add_texture();
-IMX_API bool begin_frame();
-IMX_API bool end_frame(BLContextFlushFlags flags = BL_CONTEXT_FLUSH_NO_FLAGS);
-IMX_API bool enqueue_expose();
 
 } // namespace imx
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "imx/api.hpp"
+#include "imx/texture.hpp"
+#include <array>
 #include <blend2d.h>
+#include <cstddef>
 #include <cstdint>
 #include <imgui.h>
+#include <string>
 #include <string_view>
+#include <vector>
 
 namespace imx {
 
@@ -12,14 +17,169 @@ static const std::uint32_t IMX_24BIT_DEPTH = 32;
 static const std::uint32_t IMX_32BIT_DEPTH = 32;
 static const ImVec4 IMX_NO_COLOR = {-1, -1, -1, -1};
 
+// Counters of the pre-rasterized glyph atlas. hits and misses count lookups
+// since the renderer was initialized, flushes the times the atlas ran out of
+// budget and was rebuilt.
+struct glyph_cache_stats {
+  std::size_t glyphs = 0;
+  std::size_t hits = 0;
+  std::size_t misses = 0;
+  std::size_t used_bytes = 0;
+  std::size_t budget_bytes = 0;
+  std::size_t flushes = 0;
+};
+
+// What is kept of the font atlas pixels once the fonts are built. The
+// renderer draws glyphs from their outlines and never samples the atlas,
+// alpha8 keeps ImGui's own pixels for code that reads them, none releases
+// them and keeps only the glyph uvs.
+enum class font_atlas_mode : std::uint8_t { alpha8, none };
+
+// Settings that are fixed once the renderer is initialized
+struct renderer_options {
+  // File the baked font atlas is kept in between runs so later starts skip
+  // rasterizing the fonts, empty disables the cache
+  std::string_view font_atlas_cache{};
+  font_atlas_mode font_atlas = font_atlas_mode::alpha8;
+  // Backs window framebuffers with huge pages to cut TLB misses while
+  // drawing and presenting, regular pages are used if none are reserved
+  bool framebuffer_huge_pages = false;
+  // Sends a downscaled copy of every frame to the Tracy profiler, only
+  // available when imx is built with instrumentation
+  bool profiler_frame_images = false;
+};
+
+// Approximate heap memory held by the renderer in bytes, split by owner
+struct renderer_memory {
+  std::size_t font_atlas = 0;
+  std::size_t glyph_lookup = 0;
+  std::size_t glyph_cache = 0;
+  std::size_t text_runs = 0;
+  std::size_t textures = 0;
+  std::size_t gradients = 0;
+  std::size_t draw_data = 0;
+
+  [[nodiscard]] std::size_t total() const {
+    return font_atlas + glyph_lookup + glyph_cache + text_runs + textures +
+           gradients + draw_data;
+  }
+};
+
+// What the last frame was made of. triangles counts the triangles ImGui
+// submitted, glyphs, polygons, gradient_quads and edges what they were
+// converted into and invalid_topologies the outlines that could not be
+// closed.
+struct frame_counts {
+  std::size_t draw_lists = 0;
+  // Everything the triangles were converted into, glyphs included
+  std::size_t shapes = 0;
+  std::size_t commands = 0;
+  std::size_t triangles = 0;
+  std::size_t glyphs = 0;
+  std::size_t polygons = 0;
+  std::size_t gradient_quads = 0;
+  std::size_t edges = 0;
+  std::size_t invalid_topologies = 0;
+};
+
+// Percentiles of a duration over the most recent frames, in microseconds
+struct timing_percentiles {
+  double p50 = 0;
+  double p95 = 0;
+  double p99 = 0;
+};
+
+// Counts and durations of the last rendered frame in microseconds, next to
+// the percentiles of the last 256 frames. Presenting is only measured for
+// windows and finishes after the frame was rendered, present_us belongs to
+// the last frame the window system completed.
+struct frame_stats {
+  std::uint64_t frames = 0;
+  frame_counts counts{};
+  double convert_us = 0;
+  double raster_us = 0;
+  double flush_us = 0;
+  double present_us = 0;
+  timing_percentiles convert{};
+  timing_percentiles raster{};
+  timing_percentiles flush{};
+  timing_percentiles present{};
+};
+
+// Cost of one ImDrawList of the last rendered frame, usually one ImGui
+// window, named after the window owning it. bounds covers the clip
+// rectangles of its commands. raster_us is the time spent drawing it on the
+// calling thread, contexts with worker threads rasterize during the flush.
+struct draw_list_cost {
+  std::string name;
+  BLRect bounds{};
+  double convert_us = 0;
+  double raster_us = 0;
+  std::size_t commands = 0;
+  std::size_t triangles = 0;
+  std::size_t shapes = 0;
+  std::size_t glyphs = 0;
+};
+
+// Time from input reaching imx until the first frame responding to it is
+// presented, measured for windows only. The percentiles cover the last 256
+// measurements and the histogram all of them in buckets of bucket_us, the
+// last bucket collecting everything slower.
+struct input_latency {
+  static constexpr double bucket_us = 2000;
+  std::uint64_t samples = 0;
+  double last_us = 0;
+  timing_percentiles percentiles{};
+  std::array<std::uint64_t, 32> histogram{};
+};
+
 IMX_API bool initialize(std::string_view font_filename,
                         ImVec4 clear_color = {0.F, 0.F, 0.F, 1.F},
                         BLContextCreateInfo context_creation_info = {},
-                        BLImageData shared_image_data = {});
+                        BLImageData shared_image_data = {},
+                        renderer_options const &options = {});
+// Initializes only the renderer, without connecting to a display server.
+// Frames are rendered into the caller owned pixels of target, which must be
+// PRGB32 and stay valid until another target is set.
+IMX_API bool initialize_headless(std::string_view font_filename,
+                                 BLImageData target,
+                                 ImVec4 clear_color = {0.F, 0.F, 0.F, 1.F},
+                                 BLContextCreateInfo context_creation_info = {},
+                                 renderer_options const &options = {});
+// Renders following frames into other caller owned pixels, for example
+// after resizing them
+IMX_API bool set_render_target(BLImageData target);
+// Windows and events are only available when imx is built with X11
 IMX_API bool create_window(std::uint32_t width, std::uint32_t height,
                            std::uint32_t depth = IMX_32BIT_DEPTH);
 IMX_API bool poll_events(BLContextFlushFlags flags = BL_CONTEXT_FLUSH_NO_FLAGS);
+IMX_API bool enqueue_expose();
+IMX_API bool begin_frame();
 IMX_API bool draw_frame(ImDrawData const *draw_data,
                         ImVec4 clear_color = IMX_NO_COLOR);
+// Renders the frame passed to draw_frame, the pixels are complete once it
+// returns
+IMX_API bool end_frame(BLContextFlushFlags flags = BL_CONTEXT_FLUSH_NO_FLAGS);
+// Allows shapes of a draw command that do not overlap to be drawn out of
+// order, looking at most window shapes ahead, so that shapes sharing the
+// same fill style are drawn together. 0 keeps the submitted order.
+IMX_API void set_state_batching(std::size_t window);
+IMX_API renderer_memory get_renderer_memory();
+IMX_API glyph_cache_stats get_glyph_cache_stats();
+// Collected for every frame, reading them is cheap enough to do each frame
+IMX_API frame_stats get_frame_stats();
+IMX_API input_latency get_input_latency();
+// In the order ImGui submitted the draw lists
+IMX_API std::vector<draw_list_cost> get_draw_list_costs();
+// Shades every draw list of following frames by its cost, from green for
+// cheap to red for the most expensive of the frame, labelled with its name
+// and time
+IMX_API void set_cost_overlay(bool enabled);
+// Limits the memory of the glyph atlas, 4 MiB by default
+IMX_API void set_glyph_cache_budget(std::size_t bytes);
+// Records the draw data of every following frame into a file that
+// imx_replay renders again without a window, replacing an earlier capture
+IMX_API bool start_capture(std::string_view path);
+IMX_API void stop_capture();
 
 } // namespace imx
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "imx/api.hpp"
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <imgui.h>
+#include <string_view>
+
+namespace imx {
+
+// Sampling used when a texture is drawn at a size other than its own
+enum class texture_filter : std::uint8_t { nearest, bilinear };
+
+// Snapshot of a single registered texture. A texture that has been evicted to
+// honour the memory budget keeps its handle but is no longer resident.
+// loading is set while an asynchronous load is in flight and failed once
+// one could not be decoded.
+struct texture_info {
+  std::int32_t width = 0;
+  std::int32_t height = 0;
+  std::size_t bytes = 0;
+  std::uint32_t references = 0;
+  std::uint64_t last_used_frame = 0;
+  texture_filter filter = texture_filter::bilinear;
+  bool resident = false;
+  bool loading = false;
+  bool failed = false;
+};
+
+// Totals for all textures in the registry. A budget of 0 disables eviction.
+struct texture_memory {
+  std::size_t used_bytes = 0;
+  std::size_t budget_bytes = 0;
+  std::size_t textures = 0;
+  std::size_t resident = 0;
+  std::size_t evictions = 0;
+};
+
+// Registers an image and returns a stable handle suitable for ImGui::Image.
+// The handle starts with a single reference. Handles pack a slot index and
+// a generation into the pointer sized ImTextureID, so imx needs a 64 bit
+// build.
+IMX_API ImTextureID add_texture(BLImage const &image);
+// Registers a texture and decodes the image file on a background worker,
+// optionally reading it through a memory mapping. The handle can be drawn
+// right away and shows the placeholder colour until the image is published
+// at the start of a later frame. Textures loaded this way are loaded again
+// when drawn after being evicted.
+IMX_API ImTextureID load_texture_async(std::string_view path,
+                                       bool memory_map = false);
+IMX_API void set_texture_placeholder(ImVec4 color);
+// Replaces the pixels of a texture, this also makes an evicted texture
+// resident again.
+IMX_API bool update_texture(ImTextureID texture, BLImage const &image);
+IMX_API bool retain_texture(ImTextureID texture);
+// Drops one reference, the texture is destroyed and its handle invalidated
+// when the last reference is removed.
+IMX_API bool remove_texture(ImTextureID texture);
+// Returns nullptr for stale handles and evicted textures. The pointer stays
+// valid until the texture is removed, updated or evicted.
+IMX_API BLImage const *get_texture(ImTextureID texture);
+IMX_API bool set_texture_filter(ImTextureID texture, texture_filter filter);
+IMX_API texture_info get_texture_info(ImTextureID texture);
+IMX_API texture_memory get_texture_memory();
+// Enables least recently used eviction once resident textures exceed the
+// given number of bytes. Textures drawn in the last frame are never evicted.
+IMX_API void set_texture_budget(std::size_t bytes);
+
+} // namespace imx
@@ -1,6 +1,17 @@
-#include "imx/context.hpp"
+#include "glyph_cache.hpp"
+#include "gradient_cache.hpp"
+#include "hasher.hpp"
+#include "atlas_cache.hpp"
+#include "capture.hpp"
+#include "font_cache.hpp"
 #include "imx/imx.hpp"
-#include <X11/Xlib.h>
+#include "instrumentation.hpp"
+#include "platform.hpp"
+#include "render.hpp"
+#include "render_state.hpp"
+#include "text_run_cache.hpp"
+#include "texture_registry.hpp"
+#include "timing_history.hpp"
 #include <algorithm>
 #include <blend2d.h>
 #include <cmath>
@@ -13,90 +24,66 @@
 #include <limits>
 #include <map>
 #include <memory>
+#include <optional>
+#include <string>
 #include <string_view>
-#include <tracy/Tracy.hpp>
+#include <utility>
 #include <variant>
 #include <vector>
 
-#define IMBLEND_COLOR_PICKER_HACK 1;
-
 namespace imx {
 
+// Glyph of the ImGui font atlas. x and y lead from the top left corner of
+// the glyph quad to the pen position and width and height are the size of
+// the quad, all in pixels of the font source before any scaling.
 struct face_offset {
   ImWchar c;
+  std::uint16_t face;
   float x;
   float y;
+  float width;
+  float height;
 };
 namespace {
 std::map<std::uint64_t, face_offset> g_font_look_up{};
 std::array<float, 2> g_h_uv{};
 } // namespace
 
-template <std::size_t N> struct text {
-  static constexpr std::size_t size = N;
-  std::array<ImWchar, N> chars;
-  BLPoint pt;
-  BLRgba32 color;
-  BLFont const *font;
-  std::uint32_t depth;
-};
-
-struct polygon {
-  std::vector<BLPoint> points;
-  std::vector<BLPoint> uvs;
-  BLRgba32 color;
-  std::uint32_t depth;
-  ImTextureID texture;
-};
-
-#if defined(IMBLEND_COLOR_PICKER_HACK)
-struct graded_quad {
-  std::array<BLPoint, 4> points;
-  std::array<BLRgba32, 4> colors;
-  std::uint32_t depth;
-  ImTextureID texture;
-};
-#endif
-
-struct line {
-  std::vector<BLPoint> points;
-  BLRgba32 color;
-  float size;
-  std::uint32_t depth;
-};
-
-#if defined(IMBLEND_COLOR_PICKER_HACK)
-using shape = std::variant<text<1>, polygon, graded_quad, line>;
-#else
-using shape = std::variant<text<1>, polygon, line>;
-#endif
-
-using draw_command = std::pair<BLRect, std::vector<shape>>;
-using draw_list = std::vector<draw_command>;
-
 struct imblend_context {
   BLContext ctx{};
   BLImage img{};
   BLImageData data{};
   BLContextCreateInfo info{};
-  BLFont font{};
+  font_cache fonts{};
   ImVec4 clear_color = ImVec4(0.45F, 0.55F, 0.60F, 1.00F);
-  std::array<std::vector<draw_list>, 2> draw_buffers;
+  std::array<frame_data, 2> draw_buffers;
   std::size_t buffer = 0;
-  std::vector<BLImage> textures{};
+  texture_registry textures{};
+  gradient_cache gradient_styles{};
+  glyph_cache glyphs{};
+  text_run_cache text_runs{};
+  // Reused for every text run so looking a run up does not allocate
+  run_key text_run_key{};
+  // Shapes of a command that may be reordered to batch equal state, 0 keeps
+  // the order ImGui submitted them in
+  std::size_t batch_window = 0;
+  font_atlas_mode font_atlas = font_atlas_mode::alpha8;
+  capture_writer capture{};
+  bool profiler_frame_images = false;
+  bool cost_overlay = false;
+  // Downscaled copy of the last frame sent to the profiler
+  BLImage frame_image{};
+  frame_stats stats{};
+  timing_history convert_times{};
+  timing_history raster_times{};
+  timing_history flush_times{};
+  timing_history present_times{};
 
   explicit imblend_context(std::string_view font_filename,
                            ImVec4 clear_color = {0.45F, 0.55F, 0.60F, 1.00F},
                            BLContextCreateInfo context_creation_info = {},
-                           BLImageData shared_image_data = {});
-};
-
-struct edge_t {
-  ImDrawIdx p0;
-  ImDrawIdx p1;
-  ImU32 col;
-  std::uint32_t depth;
-  ImTextureID texture;
+                           BLImageData shared_image_data = {},
+                           renderer_options const &options = {});
 };
 
 constexpr std::uint64_t hash_edge(std::uint32_t const a,
@@ -108,9 +95,10 @@ constexpr std::uint32_t hash_edge(std::uint16_t a, std::uint16_t b) {
   return (static_cast<std::uint32_t>(a) << 16U) | static_cast<std::uint32_t>(b);
 }
 
+// Fine enough to keep the glyphs of every font in a large atlas apart
 constexpr std::uint64_t uv_to_key(float u, float v) {
-  return hash_edge(static_cast<std::uint32_t>(u * 1000U),
-                   static_cast<std::uint32_t>(v * 1000U));
+  return hash_edge(static_cast<std::uint32_t>(u * 65536U),
+                   static_cast<std::uint32_t>(v * 65536U));
 }
 
 constexpr bool almostEqual(double a, double b, double epsilon = 1e-6) {
@@ -137,22 +125,65 @@ template <> constexpr BLRect get_bounds<ImVec4>(ImVec4 const &vec4) {
   return {vec4.x, vec4.y, vec4.z - vec4.x, vec4.w - vec4.y};
 }
 
-constexpr bool operator==(edge_t const &a, edge_t const &b) {
-  return a.p0 == b.p0 && a.p1 == b.p1;
+constexpr BLRect intersect(BLRect const &a, BLRect const &b) {
+  double x0 = std::max(a.x, b.x);
+  double y0 = std::max(a.y, b.y);
+  double x1 = std::min(a.x + a.w, b.x + b.w);
+  double y1 = std::min(a.y + a.h, b.y + b.h);
+  return {x0, y0, std::max(0.0, x1 - x0), std::max(0.0, y1 - y0)};
 }
 
-constexpr bool operator<(edge_t const &a, edge_t const &b) {
-  if (a.p0 < b.p0)
-    return true;
-  if (a.p0 > b.p0)
-    return false;
-  return a.p1 > b.p1;
+constexpr bool is_empty(BLRect const &rect) {
+  return rect.w <= 0 || rect.h <= 0;
 }
 
-template <std::size_t N> void draw(BLContext &ctx, text<N> const &unicode) {
-  ZoneScopedN("Draw utf16");
-  ctx.fillUtf16Text(unicode.pt, *(unicode.font), unicode.chars.data(), N,
-                    unicode.color);
+constexpr BLRect unite(BLRect const &a, BLRect const &b) {
+  if (is_empty(a)) {
+    return b;
+  }
+  double x0 = std::min(a.x, b.x);
+  double y0 = std::min(a.y, b.y);
+  double x1 = std::max(a.x + a.w, b.x + b.w);
+  double y1 = std::max(a.y + a.h, b.y + b.h);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+// Checks if the bounds of a triangle touch the clip rectangle, glyph quads
+// need no special care as their first triangle spans the whole quad
+constexpr bool overlaps(BLRect const &clip, ImDrawVert const &a,
+                        ImDrawVert const &b, ImDrawVert const &c) {
+  float min_x = std::min({a.pos.x, b.pos.x, c.pos.x});
+  float max_x = std::max({a.pos.x, b.pos.x, c.pos.x});
+  float min_y = std::min({a.pos.y, b.pos.y, c.pos.y});
+  float max_y = std::max({a.pos.y, b.pos.y, c.pos.y});
+  return max_x > clip.x && min_x < clip.x + clip.w && max_y > clip.y &&
+         min_y < clip.y + clip.h;
+}
+
+glyph_cache *glyphs();
+
+template <std::size_t N>
+void draw(render_state &state, text<N> const &unicode) {
+  IMX_ZONE_NAMED(shape, "Draw utf16");
+  state.comp_op(BL_COMP_OP_SRC_OVER);
+  state.fill_style(unicode.color);
+  if (auto *cache = glyphs(); cache != nullptr && unicode.mask) {
+    if (unicode.mask->area.w != 0) {
+      state.context().fillMask(unicode.mask->origin, cache->atlas(),
+                               unicode.mask->area);
+    }
+    return;
+  }
+  state.context().fillUtf16Text(unicode.pt, *(unicode.font),
+                                unicode.chars.data(), N);
+}
+
+texture_registry::texture_view use_texture(ImTextureID texture,
+                                           BLSize const &extent);
+
+constexpr BLPatternQuality as_pattern_quality(texture_filter filter) {
+  return filter == texture_filter::nearest ? BL_PATTERN_QUALITY_NEAREST
+                                           : BL_PATTERN_QUALITY_BILINEAR;
 }
 
 BLMatrix2D as_transform(BLRect uvs, double width, double height) {
@@ -162,108 +193,159 @@ BLMatrix2D as_transform(BLRect uvs, double width, double height) {
   return M;
 }
 
-void draw(BLContext &ctx, polygon const &poly) {
-  ZoneScopedN("Draw polygon");
+void draw(render_state &state, polygon const &poly) {
+  IMX_ZONE_NAMED(shape, "Draw polygon");
+  auto &ctx = state.context();
   auto uvs = get_bounds(poly.uvs);
   if (poly.texture != nullptr && uvs.h != 0) {
-    BLImage const &texture = *reinterpret_cast<BLImage const *>(poly.texture);
+    auto trg = get_bounds(poly.points);
+    // Textures that were removed or evicted since the frame was converted
+    // are skipped
+    auto view =
+        use_texture(poly.texture, BLSize(trg.w / uvs.w, trg.h / uvs.h));
+    if (view.image == nullptr) {
+      if (view.pending) {
+        state.comp_op(BL_COMP_OP_SRC_OVER);
+        state.fill_style(view.placeholder);
+        ctx.fillPolygon(poly.points.data(), poly.points.size());
+      }
+      return;
+    }
+    BLImage const &texture = *view.image;
     auto orig = BLRect(0, 0, texture.width(), texture.height());
     auto src = orig;
     src.x *= 1.0 / uvs.w;
     src.y *= 1.0 / uvs.h;
     src.w *= 1.0 / uvs.w;
     src.h *= 1.0 / uvs.h;
-    auto trg = get_bounds(poly.points);
     BLPattern pattern(texture);
     pattern.translate(src.x, src.y);
     pattern.scale(trg.w / src.w, trg.h / src.h);
     pattern.postTranslate(trg.x, trg.y);
-    ctx.setCompOp(BL_COMP_OP_SRC_ATOP);
+    state.comp_op(BL_COMP_OP_SRC_ATOP);
+    state.pattern_quality(as_pattern_quality(view.filter));
     ctx.fillPolygon(poly.points.data(), poly.points.size(), pattern);
   } else {
-    ctx.fillPolygon(poly.points.data(), poly.points.size(), poly.color);
+    state.comp_op(BL_COMP_OP_SRC_OVER);
+    state.fill_style(poly.color);
+    ctx.fillPolygon(poly.points.data(), poly.points.size());
   }
 }
 
-#if defined(IMBLEND_COLOR_PICKER_HACK)
-void draw(BLContext &ctx, graded_quad const &poly) {
-  ZoneScopedN("Draw graded_quad");
-  double max_x = -std::numeric_limits<double>::max();
-  double min_x = std::numeric_limits<double>::max();
-  double min_y = min_x;
-  double max_y = max_x;
-  for (auto const &pt : poly.points) {
-    max_x = std::max(pt.x, max_x);
-    min_x = std::min(pt.x, min_x);
-    max_y = std::max(pt.y, max_y);
-    min_y = std::min(pt.y, min_y);
+void draw(render_state &state, image_quad const &quad) {
+  IMX_ZONE_NAMED(shape, "Draw image");
+  auto &ctx = state.context();
+  state.comp_op(BL_COMP_OP_SRC_OVER);
+  auto view = use_texture(quad.texture, BLSize(quad.rect.w / quad.uvs.w,
+                                                quad.rect.h / quad.uvs.h));
+  if (view.image == nullptr) {
+    if (view.pending) {
+      state.fill_style(view.placeholder);
+      ctx.fillRect(quad.rect);
+    }
+    return;
   }
-  auto pt0_idx = std::numeric_limits<std::size_t>::max();
-  auto pt1_idx = std::numeric_limits<std::size_t>::max();
-  auto pt2_idx = std::numeric_limits<std::size_t>::max();
-  auto pt3_idx = std::numeric_limits<std::size_t>::max();
+  BLImage const &texture = *view.image;
+  BLRectI src(static_cast<int>(std::lround(quad.uvs.x * texture.width())),
+              static_cast<int>(std::lround(quad.uvs.y * texture.height())),
+              static_cast<int>(std::lround(quad.uvs.w * texture.width())),
+              static_cast<int>(std::lround(quad.uvs.h * texture.height())));
+  if (src.w <= 0 || src.h <= 0) {
+    return;
+  }
+  // Unscaled quads are plain copies, everything else is resampled with the
+  // filter chosen for the texture
+  if (almostEqual(quad.rect.w, src.w, 1e-3) &&
+      almostEqual(quad.rect.h, src.h, 1e-3)) {
+    ctx.blitImage(BLPoint(quad.rect.x, quad.rect.y), texture, src);
+  } else {
+    state.pattern_quality(as_pattern_quality(view.filter));
+    ctx.blitImage(quad.rect, texture, src);
+  }
+}
 
-  for (auto idx = 0UL; idx != poly.points.size(); ++idx) {
-    auto const &pnt = poly.points[idx];
-    if (pnt.x == min_x && pnt.y == min_y) {
-      pt0_idx = idx;
-      continue;
-    }
-    if (pnt.x == max_x && pnt.y == min_y) {
-      pt1_idx = idx;
-      continue;
-    }
-    if (pnt.x == max_x && pnt.y == max_y) {
-      pt2_idx = idx;
-      continue;
-    }
-    if (pnt.x == min_x && pnt.y == max_y) {
-      pt3_idx = idx;
+gradient_cache *gradients();
+
+void draw(render_state &state, gradient_quad const &quad) {
+  IMX_ZONE_NAMED(shape, "Draw gradient quad");
+  auto &ctx = state.context();
+  state.comp_op(BL_COMP_OP_SRC_OVER);
+  auto *cache = gradients();
+  if (cache == nullptr) {
+    return;
+  }
+  auto const &rect = quad.rect;
+  auto const &cols = quad.colors;
+  auto left = rect.x;
+  auto right = rect.x + rect.w;
+  auto top = rect.y;
+  auto bottom = rect.y + rect.h;
+  if (cols[0] == cols[3] && cols[1] == cols[2]) {
+    ctx.fillRect(rect, cache->linear(BLPoint(left, top), BLPoint(right, top),
+                                     cols[0], cols[1]));
+    return;
+  }
+  if (cols[0] == cols[1] && cols[3] == cols[2]) {
+    ctx.fillRect(rect, cache->linear(BLPoint(left, top),
+                                     BLPoint(left, bottom), cols[0], cols[3]));
+    return;
+  }
+  // Bilinear four corner gradient approximated by horizontal strips, each
+  // a linear gradient between the left and right edge colours at its centre.
+  // Strip boundaries are kept on whole pixels so anti aliasing does not
+  // leave seams between them.
+  auto strips = std::clamp(static_cast<int>(std::ceil(rect.h / 4.0)), 1, 32);
+  auto lerp = [](BLRgba32 a, BLRgba32 b, double t) {
+    auto mix = [t](std::uint32_t x, std::uint32_t y) {
+      return static_cast<std::uint32_t>(std::lround(x + (double(y) - x) * t));
+    };
+    return BLRgba32(mix(a.r(), b.r()), mix(a.g(), b.g()), mix(a.b(), b.b()),
+                    mix(a.a(), b.a()));
+  };
+  auto y0 = top;
+  for (int strip = 0; strip != strips; ++strip) {
+    auto y1 = strip + 1 == strips
+                  ? bottom
+                  : std::round(top + rect.h * (strip + 1) / strips);
+    if (y1 <= y0) {
       continue;
     }
+    auto t = ((y0 + y1) * 0.5 - top) / rect.h;
+    ctx.fillRect(BLRect(left, y0, rect.w, y1 - y0),
+                 cache->linear(BLPoint(left, y0), BLPoint(right, y0),
+                               lerp(cols[0], cols[3], t),
+                               lerp(cols[1], cols[2], t)));
+    y0 = y1;
   }
-  if (pt0_idx != std::numeric_limits<std::size_t>::max() &&
-      pt1_idx != std::numeric_limits<std::size_t>::max() &&
-      pt2_idx != std::numeric_limits<std::size_t>::max() &&
-      pt3_idx != std::numeric_limits<std::size_t>::max()) {
-
-    auto is_horizontal = [](std::array<BLRgba32, 4> const &cols) {
-      return cols[0] == cols[3] && cols[1] == cols[2];
-    };
-    auto is_vertical = [](std::array<BLRgba32, 4> const &cols) {
-      return cols[0] == cols[1] && cols[3] == cols[2];
-    };
-
-    BLRectI rect(static_cast<int>(min_x), static_cast<int>(min_y),
-                 static_cast<int>(max_x - min_x),
-                 static_cast<int>(max_y - min_y));
-
-    auto tmp = poly.colors;
-    tmp[0] = poly.colors[pt0_idx];
-    tmp[1] = poly.colors[pt1_idx];
-    tmp[2] = poly.colors[pt2_idx];
-    tmp[3] = poly.colors[pt3_idx];
+}
 
-    if (is_horizontal(tmp)) {
-      BLGradient g1(
-          BLLinearGradientValues(rect.x, rect.y, rect.x + rect.w, rect.y));
-      g1.addStop(0.0, tmp[0]);
-      g1.addStop(1.0, tmp[1]);
-      ctx.fillRect(rect, g1);
-    }
-    if (is_vertical(tmp)) {
-      BLGradient g1(
-          BLLinearGradientValues(rect.x, rect.y, rect.x, rect.y + rect.h));
-      g1.addStop(0.0, tmp[1]);
-      g1.addStop(1.0, tmp[2]);
-      ctx.fillRect(rect, g1);
-    }
+void draw(render_state &state, gradient_triangle const &triangle) {
+  IMX_ZONE_NAMED(shape, "Draw gradient triangle");
+  auto &ctx = state.context();
+  state.comp_op(BL_COMP_OP_SRC_OVER);
+  state.pattern_quality(BL_PATTERN_QUALITY_BILINEAR);
+  auto *cache = gradients();
+  if (cache == nullptr) {
+    return;
+  }
+  auto bounds = get_bounds(triangle.points);
+  auto relative = triangle.points;
+  for (auto &pt : relative) {
+    pt.x -= bounds.x;
+    pt.y -= bounds.y;
   }
+  double scale = 1.0;
+  BLImage const &shaded = cache->shaded(relative, triangle.colors, scale);
+  BLPattern pattern(shaded);
+  pattern.scale(1.0 / scale, 1.0 / scale);
+  pattern.postTranslate(bounds.x, bounds.y);
+  ctx.fillPolygon(triangle.points.data(), triangle.points.size(), pattern);
 }
-#endif
 
-void draw(BLContext &ctx, line const &line) {
-  ZoneScopedN("Draw outline");
+void draw(render_state &state, line const &line) {
+  IMX_ZONE_NAMED(shape, "Draw outline");
+  auto &ctx = state.context();
+  state.comp_op(BL_COMP_OP_SRC_OVER);
   BLPath path;
   path.moveTo(line.points.front());
   for (auto it = line.points.begin() + 1; it != line.points.end(); ++it) {
@@ -282,9 +364,9 @@ constexpr bool operator==(shape const &a, shape const &b) {
          std::visit([](auto const &i) { return i.depth; }, b);
 }
 
-void draw(BLContext &ctx, std::vector<shape> const &shapes) {
+void draw(render_state &state, std::vector<shape> const &shapes) {
   for (auto const &s : shapes) {
-    std::visit([&](auto const &x) { draw(ctx, x); }, s);
+    std::visit([&](auto const &x) { draw(state, x); }, s);
   }
 }
 
@@ -293,36 +375,156 @@ constexpr BLRgba32 as_rgba(ImU32 x) {
                   ((x << 16) & 0xFF0000));
 }
 
+// vtx is the top left and opposite the bottom right corner of a glyph quad
 bool create_glyph(std::vector<shape> &output, ImDrawVert const &vtx,
-                  std::uint32_t current_depth) {
-  ZoneScoped;
+                  ImDrawVert const &opposite, std::uint32_t current_depth) {
+  IMX_ZONE(shape);
 
   if (auto *context = static_cast<imblend_context *>(
           ImGui::GetIO().BackendRendererUserData)) {
     std::array<float, 2> uv = {vtx.uv.x, vtx.uv.y};
     auto key = uv_to_key(uv[0], uv[1]);
-    auto H = g_font_look_up.cbegin()->first;
     auto found = g_font_look_up.find(key);
     if (found != g_font_look_up.cend()) { // TODO: Try a vector instead
-      output.push_back(text<1>{
-          {found->second.c},
-          BLPoint(vtx.pos.x - found->second.x + 0.5F, // TODO: Validate this if
-                                                      // we need the +0.5F
-                  vtx.pos.y - found->second.y),
+      auto const &offset = found->second;
+      // The quad is the glyph scaled by the font size of the window and the
+      // global font scale, the longer side gives the most precise factor
+      auto scale = offset.height >= offset.width
+                       ? (opposite.pos.y - vtx.pos.y) / offset.height
+                       : (opposite.pos.x - vtx.pos.x) / offset.width;
+      BLFont const *font =
+          scale > 0 ? context->fonts.get(offset.face, scale) : nullptr;
+      if (font == nullptr) {
+        return false;
+      }
+      text<1> glyph{
+          {offset.c},
+          BLPoint(vtx.pos.x - offset.x * scale + 0.5F, // TODO: Validate this if
+                                                       // we need the +0.5F
+                  vtx.pos.y - offset.y * scale),
           as_rgba(vtx.col),
-          &context->font,
-          current_depth});
+          font,
+          current_depth,
+          std::nullopt};
+      glyph.mask = context->glyphs.find(*font, offset.c, glyph.pt);
+      output.push_back(glyph);
       return true;
     }
   }
   return false;
 }
 
+// Number of glyph quads at the start of indices: two triangles over four
+// consecutive vertices forming an axis aligned rectangle of a single
+// colour with a uv rectangle of non zero size, as emitted by ImGui for
+// every visible glyph
+std::size_t glyph_run_length(ImDrawIdx const *indices,
+                             ImDrawVert const *vtx_buffer,
+                             unsigned int available) {
+  std::size_t quads = 0;
+  auto color = vtx_buffer[indices[0]].col;
+  for (unsigned int i = 0; i + 6 <= available; i += 6) {
+    auto const *idx = indices + i;
+    auto a = idx[0];
+    if (idx[1] != a + 1 || idx[2] != a + 2 || idx[3] != a || idx[4] != a + 2 ||
+        idx[5] != a + 3) {
+      break;
+    }
+    auto const *vtx = vtx_buffer + a;
+    if (vtx[0].col != color || vtx[1].col != color || vtx[2].col != color ||
+        vtx[3].col != color || vtx[0].pos.y != vtx[1].pos.y ||
+        vtx[1].pos.x != vtx[2].pos.x || vtx[0].uv.x == vtx[2].uv.x) {
+      break;
+    }
+    ++quads;
+  }
+  return quads;
+}
+
+// Converts a run of glyph quads at the start of indices through the text
+// run cache. Returns the number of indices consumed, 0 if the quads are not
+// a run of known glyphs and must be converted one by one.
+unsigned int convert_text_run(std::vector<shape> &output,
+                              ImDrawIdx const *indices,
+                              ImDrawVert const *vtx_buffer,
+                              unsigned int available,
+                              std::uint32_t &current_depth) {
+  static constexpr std::size_t s_min_glyphs = 2;
+  auto *context =
+      static_cast<imblend_context *>(ImGui::GetIO().BackendRendererUserData);
+  if (context == nullptr) {
+    return 0;
+  }
+  auto quads = glyph_run_length(indices, vtx_buffer, available);
+  if (quads < s_min_glyphs) {
+    return 0;
+  }
+  IMX_ZONE(shape);
+  auto const &first = vtx_buffer[indices[0]];
+  BLPoint origin(std::floor(first.pos.x), std::floor(first.pos.y));
+  auto &key = context->text_run_key;
+  key.color = first.col;
+  key.subpixel = ImVec2(first.pos.x - static_cast<float>(origin.x),
+                        first.pos.y - static_cast<float>(origin.y));
+  key.quads.clear();
+  hasher hash;
+  hash.add(key.color).add(key.subpixel);
+  for (std::size_t quad = 0; quad != quads; ++quad) {
+    auto const &vtx = vtx_buffer[indices[quad * 6]];
+    auto const &opposite = vtx_buffer[indices[quad * 6 + 2]];
+    hash.add(key.quads.emplace_back(run_quad{
+        vtx.uv, ImVec2(vtx.pos.x - first.pos.x, vtx.pos.y - first.pos.y),
+        ImVec2(opposite.pos.x - vtx.pos.x, opposite.pos.y - vtx.pos.y)}));
+  }
+  key.hash = hash.value;
+
+  auto const *run = context->text_runs.find(key);
+  if (run == nullptr) {
+    std::vector<shape> glyphs;
+    std::vector<run_glyph> resolved;
+    for (std::size_t quad = 0; quad != quads; ++quad) {
+      if (!create_glyph(glyphs, vtx_buffer[indices[quad * 6]],
+                        vtx_buffer[indices[quad * 6 + 2]], 0)) {
+        context->text_runs.insert(key, {});
+        return 0;
+      }
+      auto const &glyph = std::get<text<1>>(glyphs.back());
+      auto &cached = resolved.emplace_back(run_glyph{
+          glyph.chars[0],
+          BLPoint(glyph.pt.x - origin.x, glyph.pt.y - origin.y), glyph.font,
+          glyph.mask});
+      if (cached.mask) {
+        cached.mask->origin.x -= static_cast<int>(origin.x);
+        cached.mask->origin.y -= static_cast<int>(origin.y);
+      }
+    }
+    run = context->text_runs.insert(key, std::move(resolved));
+  }
+  if (run->empty()) {
+    return 0;
+  }
+  auto color = as_rgba(first.col);
+  for (auto const &glyph : *run) {
+    text<1> &created = std::get<text<1>>(output.emplace_back(
+        text<1>{{glyph.c},
+                BLPoint(origin.x + glyph.pen.x, origin.y + glyph.pen.y),
+                color,
+                glyph.font,
+                current_depth++,
+                glyph.mask}));
+    if (created.mask) {
+      created.mask->origin.x += static_cast<int>(origin.x);
+      created.mask->origin.y += static_cast<int>(origin.y);
+    }
+  }
+  return static_cast<unsigned int>(quads * 6);
+}
+
 // TODO: replace pointer interface with span
 void generate_edges(std::map<edge_t, bool> &output, ImDrawIdx const *idx_buffer,
                     ImDrawVert const *vtx_buffer, std::uint32_t start,
                     std::uint32_t depth, ImTextureID texture) {
-  ZoneScoped;
+  IMX_ZONE(shape);
   std::map<edge_t, bool>::const_iterator iter;
   bool inserted = true;
   std::tie(iter, inserted) = output.try_emplace(
@@ -342,93 +544,116 @@ void generate_edges(std::map<edge_t, bool> &output, ImDrawIdx const *idx_buffer,
   output.at(iter->first) = inserted;
 }
 
-bool is_graded_quad(std::vector<BLPoint> const &outline,
-                    std::vector<BLRgba32> const &colors) {
-  // Very ugly hack here...the imgui colorpicker is rendered with a
-  // collection of vertex colored quads. blend2d does not (at the time
-  // of writing) have a fill type that is similar to vertex colors but
-  // as luck would have it ImGui (at time time of writing) actually
-  // implements this shading using overlayed linear gradings. One
-  // horizontal from white to color and one vertical from transparent to
-  // opaque black. We can exploit this fact by first detecting if the
-  // current shape is a quad and more then that if it is a quad that is
-  // also its bounds. If this is the case and vertex colors are used
-  // then we create the special shape that attempts to shade using
-  // linear gradient
-  //
-  // This obviously depends on logic in the rendering of imgui so will
-  // likely break at some point however at the moment it is the only
-  // option available to us if we want to render the colorpicker
-  //
-  // This section is overly commented so we will remember all our
-  // assumtions later on when this breaks
-  //
-  auto is_rect = [](std::vector<BLPoint> const &pnts) {
-    // We assume a rectangle is made up of points 1, 2, 3, 4 and 5
-    // replicating point 1
-    if (pnts.size() != 5) {
+bool is_rect(std::vector<BLPoint> const &pnts) {
+  // We assume a rectangle is made up of points 1, 2, 3, 4 and 5
+  // replicating point 1
+  if (pnts.size() != 5) {
+    return false;
+  }
+  // We assume quads of interest must have as its corners its own
+  // bounds, it seems that imgui has may triangle shapes that are
+  // infact quads in the topology with the second triangle
+  // collapsed so we want to make sure we dont pick up any of these
+  // shapes
+  double max_x = -std::numeric_limits<double>::max();
+  double min_x = std::numeric_limits<double>::max();
+  double max_y = max_x;
+  double min_y = min_x;
+  for (auto const &pt : pnts) {
+    max_x = std::max(pt.x, max_x);
+    min_x = std::min(pt.x, min_x);
+    max_y = std::max(pt.y, max_y);
+    min_y = std::min(pt.y, min_y);
+    if (!almostEqual(pt.x, min_x) && !almostEqual(pt.x, max_x)) {
       return false;
     }
-    // We assume quads of interest must have as its corners its own
-    // bounds, it seems that imgui has may triangle shapes that are
-    // infact quads in the topology with the second triangle
-    // collapsed so we want to make sure we dont pick up any of these
-    // shapes
-    double max_x = -std::numeric_limits<double>::max();
-    double min_x = std::numeric_limits<double>::max();
-    double max_y = max_x;
-    double min_y = min_x;
-    for (auto const &pt : pnts) {
-      max_x = std::max(pt.x, max_x);
-      min_x = std::min(pt.x, min_x);
-      max_y = std::max(pt.y, max_y);
-      min_y = std::min(pt.y, min_y);
-      if (!almostEqual(pt.x, min_x) && !almostEqual(pt.x, max_x)) {
-        return false;
-      }
-      if (!almostEqual(pt.y, min_y) && !almostEqual(pt.y, max_y)) {
-        return false;
-      }
+    if (!almostEqual(pt.y, min_y) && !almostEqual(pt.y, max_y)) {
+      return false;
     }
-    return true;
-  };
-  // So we check if the outline is a rectangular four sided polygon and
-  // also if vertex colors are not all the same for all vertices. Since
-  // ImGui allows us to use rounded corners in a topology that is all
-  // triangles it seems unlikely that they will ever be able to support
-  // things like graded shading on item frames simply because vertex
-  // colors wont be able to provide a consistent grading due to the
-  // triangle topology. So its "probably" pretty safe to assume if they
-  // do have multiple vertex colors used in a shape this is because the
-  // shape is rectangular so linear grading is possible and in this case
-  // our algorithm should work....fingers crossed...
-  return is_rect(outline) &&
-         !std::all_of(colors.cbegin(), colors.cend(),
+  }
+  return true;
+}
+
+bool is_image_quad(std::vector<BLPoint> const &outline,
+                   std::vector<BLPoint> const &uvs,
+                   std::vector<BLRgba32> const &colors) {
+  // ImGui::Image and AddImage emit a rectangle whose corners map straight
+  // onto the corners of the uv rectangle. Anything rotated, flipped or tinted
+  // still needs the pattern fill
+  if (!is_rect(outline) ||
+      !std::all_of(colors.cbegin(), colors.cend(), [](auto const &col) {
+        return col == BLRgba32(0xFFFFFFFF);
+      })) {
+    return false;
+  }
+  auto bounds = get_bounds(outline);
+  auto uv_bounds = get_bounds(uvs);
+  if (bounds.w <= 0 || bounds.h <= 0 || uv_bounds.w <= 0 || uv_bounds.h <= 0) {
+    return false;
+  }
+  for (auto idx = 0UL; idx != outline.size(); ++idx) {
+    auto const &pnt = outline[idx];
+    auto const &uv = uvs[idx];
+    auto u = almostEqual(pnt.x, bounds.x) ? uv_bounds.x
+                                          : uv_bounds.x + uv_bounds.w;
+    auto v = almostEqual(pnt.y, bounds.y) ? uv_bounds.y
+                                          : uv_bounds.y + uv_bounds.h;
+    if (!almostEqual(uv.x, u) || !almostEqual(uv.y, v)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool has_vertex_colors(std::vector<BLRgba32> const &colors) {
+  return !std::all_of(colors.cbegin(), colors.cend(),
                       [&](auto const &col) { return col == colors[0]; });
 }
 
+gradient_quad make_gradient_quad(std::vector<BLPoint> const &outline,
+                                 std::vector<BLRgba32> const &colors,
+                                 std::uint32_t depth) {
+  gradient_quad quad{get_bounds(outline), {}, depth};
+  auto const &rect = quad.rect;
+  for (auto idx = 0UL; idx + 1 < outline.size(); ++idx) {
+    auto const &pnt = outline[idx];
+    bool left = almostEqual(pnt.x, rect.x);
+    bool top = almostEqual(pnt.y, rect.y);
+    auto corner = top ? (left ? 0 : 1) : (left ? 3 : 2);
+    quad.colors[corner] = colors[idx];
+  }
+  return quad;
+}
+
 shape generate_shape(std::vector<BLPoint> const &outline,
                      std::vector<BLPoint> const &uvs,
                      std::vector<BLRgba32> const &colors, std::uint32_t depth,
                      ImTextureID texid) {
-#if defined IMBLEND_COLOR_PICKER_HACK
-  if (is_graded_quad(outline, colors)) {
-    return graded_quad{{outline[0], outline[1], outline[2], outline[3]},
-                       {colors[0], colors[1], colors[2], colors[3]},
-                       depth,
-                       texid};
-  } else {
-    return polygon{outline, uvs, colors.front(), depth, texid};
+  if (texid != nullptr && is_image_quad(outline, uvs, colors)) {
+    return image_quad{get_bounds(outline), get_bounds(uvs), depth, texid};
+  }
+  // ImGui only varies vertex colours inside a shape for gradients, these
+  // come as rectangles (AddRectFilledMultiColor, color pickers) or as single
+  // triangles (the hue wheel). Larger meshes have already lost their inner
+  // vertices to the outline so they keep a flat colour.
+  if (has_vertex_colors(colors)) {
+    if (is_rect(outline)) {
+      return make_gradient_quad(outline, colors, depth);
+    }
+    if (outline.size() == 4) {
+      return gradient_triangle{{outline[0], outline[1], outline[2]},
+                               {colors[0], colors[1], colors[2]},
+                               depth};
+    }
   }
-#else
   return polygon{outline, uvs, colors.front(), depth, texid};
-#endif
 }
 
-void generate_topology(std::vector<shape> &output,
-                       std::map<edge_t, bool> const &edges,
-                       ImDrawVert const *vtx_buffer) {
-  ZoneScoped;
+std::size_t generate_topology(std::vector<shape> &output,
+                              std::map<edge_t, bool> const &edges,
+                              ImDrawVert const *vtx_buffer) {
+  IMX_ZONE(shape);
+  std::size_t invalid = 0;
   std::vector<edge_t> unique_edges;
   {
     for (const auto &edge : edges) {
@@ -443,7 +668,7 @@ void generate_topology(std::vector<shape> &output,
   std::vector<BLPoint> uvs;
   std::vector<BLRgba32> colors;
   {
-    ZoneScopedN("connecting edges");
+    IMX_ZONE_NAMED(shape, "connecting edges");
     auto end = unique_edges.end();
     for (auto begin = unique_edges.begin(); begin != end;) {
       auto edge = begin++; // Start from the first unprocessed edge
@@ -488,58 +713,107 @@ void generate_topology(std::vector<shape> &output,
             end = std::rotate(nextEdgeIt, nextEdgeIt + 1, end);
           } else {
             fmt::print("Invalid topology\n");
+            ++invalid;
             break; // Force start a new shape
           }
         }
       }
     }
   }
+  return invalid;
 }
 
 void process_draw_data(std::vector<draw_list> &blend_data,
-                       ImDrawData const *draw_data) {
+                       ImDrawData const *draw_data, frame_counts *counts,
+                       std::vector<draw_list_cost> *costs) {
   // Iterate over all draw lists
-  ZoneScoped;
+  IMX_ZONE(stage);
   blend_data.clear();
+  // Counted locally so the loops below keep them in registers
+  frame_counts counted{};
+  counted.draw_lists = static_cast<std::size_t>(draw_data->CmdListsCount);
+  if (costs != nullptr) {
+    costs->resize(counted.draw_lists);
+  }
+  BLRect framebuffer(draw_data->DisplayPos.x, draw_data->DisplayPos.y,
+                     draw_data->DisplaySize.x, draw_data->DisplaySize.y);
   for (int n = 0; n < draw_data->CmdListsCount; n++) {
-    ZoneScopedN("process command list");
-    ZoneValue(n);
+    IMX_ZONE_NAMED(shape, "process command list");
+    IMX_ZONE_VALUE(n);
     const ImDrawList *cmd_list = draw_data->CmdLists[n];
     const ImDrawVert *vtx_buffer = cmd_list->VtxBuffer.Data;
     const ImDrawIdx *idx_buffer = cmd_list->IdxBuffer.Data;
+    auto list_start =
+        costs != nullptr ? clock_type::now() : clock_type::time_point{};
+    auto list_counted = counted;
+    BLRect list_bounds{};
 
     draw_list &list = blend_data.emplace_back();
+    // Depth keeps counting across the list so shapes of commands that are
+    // merged into the previous command still sort after its shapes
+    std::uint32_t current_depth = 0;
+    // Only consecutive commands may be merged, anything in between such as a
+    // user callback must run in order
+    bool can_merge = false;
 
     for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
-      ZoneScopedN("process command buffer");
-      ZoneValue(cmd_i);
+      IMX_ZONE_NAMED(shape, "process command buffer");
+      IMX_ZONE_VALUE(cmd_i);
 
       const ImDrawCmd *pcmd = &cmd_list->CmdBuffer[cmd_i];
+      ++counted.commands;
+      counted.triangles += pcmd->ElemCount / 3;
       if (pcmd->UserCallback != nullptr) {
         pcmd->UserCallback(cmd_list, pcmd);
+        can_merge = false;
       } else {
+        // Commands clipped away entirely, like rows of a scrolled table or
+        // collapsed child windows, are never converted
+        auto clip = intersect(get_bounds(pcmd->ClipRect), framebuffer);
+        if (is_empty(clip)) {
+          idx_buffer += pcmd->ElemCount;
+          continue;
+        }
+        list_bounds = unite(list_bounds, clip);
         std::map<edge_t, bool> edges;
-        std::uint32_t current_depth = 0;
-        draw_command &data = list.emplace_back();
+        if (!can_merge || list.back().first != clip) {
+          list.emplace_back().first = clip;
+        }
+        can_merge = true;
+        draw_command &data = list.back();
 
-        data.first = get_bounds(pcmd->ClipRect);
         // font glyphs are always rendered on quads but as we are going to
         // use the blend2d glyph renderer and not the imgui font texture we
         // can skip the second triangle of the quad. skip_next is used to
         // signal this
         bool skip_next = false;
         {
-          ZoneScopedN("collect data");
+          IMX_ZONE_NAMED(shape, "collect data");
+          // Everything added before the topology is generated is a glyph
+          auto first_shape = data.second.size();
           for (unsigned int i = 0; i < pcmd->ElemCount; i += 3) {
             if (skip_next) {
               skip_next = false;
               continue;
             }
+            if (!overlaps(clip, vtx_buffer[idx_buffer[i + 0]],
+                          vtx_buffer[idx_buffer[i + 1]],
+                          vtx_buffer[idx_buffer[i + 2]])) {
+              continue;
+            }
             ImTextureID texture = pcmd->TextureId;
             if (texture == ImGui::GetFont()->ContainerAtlas->TexID) {
-              ZoneScopedN("check font");
+              IMX_ZONE_NAMED(shape, "check font");
+              if (auto consumed =
+                      convert_text_run(data.second, idx_buffer + i, vtx_buffer,
+                                       pcmd->ElemCount - i, current_depth);
+                  consumed != 0) {
+                i += consumed - 3;
+                continue;
+              }
               const ImDrawVert &vtx = vtx_buffer[idx_buffer[i + 0]];
-              if (create_glyph(data.second, vtx, current_depth++)) {
+              const ImDrawVert &opposite = vtx_buffer[idx_buffer[i + 2]];
+              if (create_glyph(data.second, vtx, opposite, current_depth++)) {
                 skip_next = true;
                 continue;
               }
@@ -547,108 +821,417 @@ void process_draw_data(std::vector<draw_list> &blend_data,
             generate_edges(edges, idx_buffer, vtx_buffer, i, current_depth++,
                            texture);
           }
-          generate_topology(data.second, edges, vtx_buffer);
+          auto first_outline = data.second.size();
+          counted.glyphs += first_outline - first_shape;
+          counted.shapes += first_outline - first_shape;
+          counted.edges += edges.size();
+          counted.invalid_topologies +=
+              generate_topology(data.second, edges, vtx_buffer);
+          for (auto idx = first_outline; idx != data.second.size(); ++idx) {
+            auto const &created = data.second[idx];
+            counted.polygons += std::holds_alternative<polygon>(created);
+            counted.gradient_quads +=
+                std::holds_alternative<gradient_quad>(created);
+          }
+          counted.shapes += data.second.size() - first_outline;
           std::sort(data.second.begin(), data.second.end());
         }
       }
       idx_buffer += pcmd->ElemCount;
     }
+    if (costs != nullptr) {
+      auto &cost = (*costs)[static_cast<std::size_t>(n)];
+      cost.name = cmd_list->_OwnerName != nullptr ? cmd_list->_OwnerName : "";
+      cost.bounds = list_bounds;
+      cost.convert_us = elapsed_us(list_start, clock_type::now());
+      cost.raster_us = 0;
+      cost.commands = counted.commands - list_counted.commands;
+      cost.triangles = counted.triangles - list_counted.triangles;
+      cost.shapes = counted.shapes - list_counted.shapes;
+      cost.glyphs = counted.glyphs - list_counted.glyphs;
+    }
+  }
+  if (counts != nullptr) {
+    *counts = counted;
   }
 }
 
-auto get_glyph_offset(ImFontGlyph const *glyph, float font_size) {
-  static const float s_magic_ratio = 0.875F;
-  return std::make_pair(glyph->X0, glyph->Y0 - font_size * s_magic_ratio);
+// Conservative screen bounds of a shape, glyphs use a box around their pen
+// position large enough for any glyph of the font
+BLRect shape_bounds(shape const &s) {
+  struct visitor {
+    BLRect operator()(text<1> const &glyph) const {
+      auto const &metrics = glyph.font->metrics();
+      double em = metrics.size;
+      return {glyph.pt.x - em * 0.5, glyph.pt.y - metrics.ascent - em * 0.5,
+              em * 2.0, metrics.ascent + metrics.descent + em};
+    }
+    BLRect operator()(polygon const &poly) const {
+      return get_bounds(poly.points);
+    }
+    BLRect operator()(image_quad const &quad) const { return quad.rect; }
+    BLRect operator()(gradient_quad const &quad) const { return quad.rect; }
+    BLRect operator()(gradient_triangle const &triangle) const {
+      return get_bounds(triangle.points);
+    }
+    BLRect operator()(line const &line) const {
+      auto bounds = get_bounds(line.points);
+      double pad = std::max(1.0F, line.size);
+      return {bounds.x - pad, bounds.y - pad, bounds.w + pad * 2,
+              bounds.h + pad * 2};
+    }
+  };
+  return std::visit(visitor{}, s);
 }
 
-void render_frame(BLContext &ctx, std::vector<draw_list> const &lists,
-                  BLRgba32 clear_color) {
-  ZoneScoped;
-  ctx.fillAll(clear_color);
-  for (auto const &list : lists) {
-    for (auto const &cmd : list) {
-      ctx.clipToRect(cmd.first);
-      draw(ctx, cmd.second);
-      ctx.restoreClipping();
+// Area a shape paints fully opaque, empty for anything that lets the content
+// below show through. Only the whole pixels inside the rectangle count as
+// its anti aliased edges are partially transparent.
+BLRect opaque_area(shape const &s) {
+  BLRect rect{};
+  if (auto const *poly = std::get_if<polygon>(&s)) {
+    if (poly->texture == nullptr && poly->color.a() == 255 &&
+        is_rect(poly->points)) {
+      rect = get_bounds(poly->points);
+    }
+  } else if (auto const *quad = std::get_if<gradient_quad>(&s)) {
+    if (std::all_of(quad->colors.cbegin(), quad->colors.cend(),
+                    [](auto const &col) { return col.a() == 255; })) {
+      rect = quad->rect;
+    }
+  }
+  double x0 = std::ceil(rect.x);
+  double y0 = std::ceil(rect.y);
+  double x1 = std::floor(rect.x + rect.w);
+  double y1 = std::floor(rect.y + rect.h);
+  return {x0, y0, std::max(0.0, x1 - x0), std::max(0.0, y1 - y0)};
+}
+
+constexpr bool contains(BLRect const &outer, BLRect const &inner) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.w <= outer.x + outer.w &&
+         inner.y + inner.h <= outer.y + outer.h;
+}
+
+// Appends the parts of rect outside of hole, at most four rectangles
+void subtract(std::vector<BLRect> &output, BLRect const &rect,
+              BLRect const &hole) {
+  auto overlap = intersect(rect, hole);
+  if (is_empty(overlap)) {
+    output.push_back(rect);
+    return;
+  }
+  auto right = rect.x + rect.w;
+  auto bottom = rect.y + rect.h;
+  auto overlap_right = overlap.x + overlap.w;
+  auto overlap_bottom = overlap.y + overlap.h;
+  if (overlap.y > rect.y) {
+    output.emplace_back(rect.x, rect.y, rect.w, overlap.y - rect.y);
+  }
+  if (overlap_bottom < bottom) {
+    output.emplace_back(rect.x, overlap_bottom, rect.w, bottom - overlap_bottom);
+  }
+  if (overlap.x > rect.x) {
+    output.emplace_back(rect.x, overlap.y, overlap.x - rect.x, overlap.h);
+  }
+  if (overlap_right < right) {
+    output.emplace_back(overlap_right, overlap.y, right - overlap_right,
+                        overlap.h);
+  }
+}
+
+// Walks the frame front to back collecting opaque rectangles, such as window
+// backgrounds, and drops every shape that lies entirely below one of them.
+// The occluders also decide which parts of the framebuffer need clearing.
+void cull_occluded(frame_data &frame) {
+  IMX_ZONE(stage);
+  static constexpr std::size_t s_max_occluders = 64;
+  static constexpr std::size_t s_max_clear_regions = 256;
+  std::vector<BLRect> occluders;
+  std::vector<char> hidden;
+  for (auto list = frame.lists.rbegin(); list != frame.lists.rend(); ++list) {
+    for (auto cmd = list->rbegin(); cmd != list->rend(); ++cmd) {
+      auto const &clip = cmd->first;
+      auto &shapes = cmd->second;
+      hidden.assign(shapes.size(), 0);
+      for (auto idx = shapes.size(); idx-- != 0;) {
+        auto bounds = intersect(shape_bounds(shapes[idx]), clip);
+        if (is_empty(bounds) ||
+            std::any_of(occluders.cbegin(), occluders.cend(),
+                        [&](auto const &occluder) {
+                          return contains(occluder, bounds);
+                        })) {
+          hidden[idx] = 1;
+          continue;
+        }
+        auto opaque = intersect(opaque_area(shapes[idx]), clip);
+        if (!is_empty(opaque) && occluders.size() < s_max_occluders) {
+          occluders.push_back(opaque);
+        }
+      }
+      std::size_t kept = 0;
+      for (std::size_t idx = 0; idx != shapes.size(); ++idx) {
+        if (hidden[idx] == 0) {
+          if (kept != idx) {
+            shapes[kept] = std::move(shapes[idx]);
+          }
+          ++kept;
+        }
+      }
+      shapes.erase(shapes.begin() + static_cast<std::ptrdiff_t>(kept),
+                   shapes.end());
     }
+    list->erase(std::remove_if(list->begin(), list->end(),
+                               [](auto const &cmd) {
+                                 return cmd.second.empty();
+                               }),
+                list->end());
   }
+
+  frame.clear_regions.assign(1, frame.framebuffer);
+  std::vector<BLRect> remaining;
+  for (auto const &occluder : occluders) {
+    remaining.clear();
+    for (auto const &region : frame.clear_regions) {
+      subtract(remaining, region, occluder);
+    }
+    // Heavily fragmented regions cost more to fill than a single clear
+    if (remaining.size() > s_max_clear_regions) {
+      frame.clear_regions.assign(1, frame.framebuffer);
+      return;
+    }
+    std::swap(frame.clear_regions, remaining);
+  }
+}
+
+// Shapes with equal keys need the same compositing and fill style
+std::uint64_t state_key(shape const &s) {
+  static constexpr std::uint64_t s_solid = 0;
+  static constexpr std::uint64_t s_textured = 1ULL << 56U;
+  static constexpr std::uint64_t s_image = 2ULL << 56U;
+  static constexpr std::uint64_t s_gradient = 3ULL << 56U;
+  struct visitor {
+    std::uint64_t operator()(text<1> const &glyph) const {
+      return s_solid | glyph.color.value;
+    }
+    std::uint64_t operator()(polygon const &poly) const {
+      if (poly.texture != nullptr) {
+        return s_textured | reinterpret_cast<std::uintptr_t>(poly.texture);
+      }
+      return s_solid | poly.color.value;
+    }
+    std::uint64_t operator()(image_quad const &quad) const {
+      return s_image | reinterpret_cast<std::uintptr_t>(quad.texture);
+    }
+    std::uint64_t operator()(gradient_quad const &) const {
+      return s_gradient;
+    }
+    std::uint64_t operator()(gradient_triangle const &) const {
+      return s_gradient;
+    }
+    std::uint64_t operator()(line const &line) const {
+      return s_solid | line.color.value;
+    }
+  };
+  return std::visit(visitor{}, s);
+}
+
+// Reorders the shapes of a command so that shapes with the same state are
+// drawn one after another. A shape is only moved ahead of shapes within the
+// next window shapes and only if it does not touch any of the shapes it
+// skips, so the rendered result stays the same.
+void batch_states(std::vector<shape> &shapes, std::size_t window) {
+  if (shapes.size() < 3) {
+    return;
+  }
+  std::vector<BLRect> bounds;
+  std::vector<std::uint64_t> keys;
+  bounds.reserve(shapes.size());
+  keys.reserve(shapes.size());
+  for (auto const &s : shapes) {
+    // Grown by a pixel as anti aliased edges of adjacent shapes blend into
+    // the same pixels
+    auto rect = shape_bounds(s);
+    bounds.emplace_back(rect.x - 1, rect.y - 1, rect.w + 2, rect.h + 2);
+    keys.push_back(state_key(s));
+  }
+  std::vector<shape> output;
+  output.reserve(shapes.size());
+  std::vector<char> done(shapes.size(), 0);
+  auto current = keys.front();
+  for (std::size_t first = 0; first != shapes.size();) {
+    auto pick = first;
+    if (keys[first] != current) {
+      auto last = std::min(shapes.size(), first + window);
+      for (auto idx = first + 1; idx < last; ++idx) {
+        if (done[idx] != 0 || keys[idx] != current) {
+          continue;
+        }
+        bool blocked = false;
+        for (auto skipped = first; skipped != idx && !blocked; ++skipped) {
+          blocked = done[skipped] == 0 &&
+                    !is_empty(intersect(bounds[skipped], bounds[idx]));
+        }
+        if (!blocked) {
+          pick = idx;
+          break;
+        }
+      }
+    }
+    output.push_back(std::move(shapes[pick]));
+    done[pick] = 1;
+    current = keys[pick];
+    while (first != shapes.size() && done[first] != 0) {
+      ++first;
+    }
+  }
+  std::swap(shapes, output);
+}
+
+bool contains(ImWchar const *ranges, unsigned int codepoint) {
+  for (; ranges[0] != 0; ranges += 2) {
+    if (codepoint >= ranges[0] && codepoint <= ranges[1]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Source a glyph of a font was rasterized from. Fonts merged into another
+// one contribute the codepoints of their glyph ranges, the first source
+// whose ranges cover a codepoint wins like in the atlas builder.
+ImFontConfig const *glyph_source(ImFont const &font,
+                                 unsigned int codepoint) {
+  for (int idx = 0; idx != font.ConfigDataCount; ++idx) {
+    auto const &config = font.ConfigData[idx];
+    auto const *ranges = config.GlyphRanges != nullptr
+                             ? config.GlyphRanges
+                             : font.ContainerAtlas->GetGlyphRangesDefault();
+    if (contains(ranges, codepoint)) {
+      return &config;
+    }
+  }
+  return font.ConfigData;
+}
+
+// Registers the glyphs of every font in the atlas for create_glyph
+void build_font_look_up(ImFontAtlas &atlas, font_cache &fonts) {
+  IMX_ZONE(stage);
+  g_font_look_up.clear();
+  std::map<ImFontConfig const *, std::optional<std::uint16_t>> faces;
+  for (auto const &config : atlas.ConfigData) {
+    faces[&config] = fonts.add(config);
+  }
+  for (ImFont const *font : atlas.Fonts) {
+    for (auto const &glyph : font->Glyphs) {
+      if (!glyph.Visible) {
+        continue;
+      }
+      auto const *config = glyph_source(*font, glyph.Codepoint);
+      auto face = faces.find(config);
+      if (face == faces.end() || !face->second) {
+        continue;
+      }
+      // The builder places glyphs below the rounded ascent of the font they
+      // are merged into and shifts them by the offset of their source
+      auto baseline = std::round(font->Ascent) + config->GlyphOffset.y;
+      g_font_look_up[uv_to_key(glyph.U0, glyph.V0)] = face_offset{
+          static_cast<ImWchar>(glyph.Codepoint), *face->second,
+          glyph.X0 - config->GlyphOffset.x, glyph.Y0 - baseline,
+          glyph.X1 - glyph.X0, glyph.Y1 - glyph.Y0};
+    }
+  }
+}
+
+void render_frame(BLContext &ctx, frame_data const &frame,
+                  BLRgba32 clear_color, std::vector<draw_list_cost> *costs) {
+  IMX_ZONE(stage);
+  render_state state(ctx);
+  state.reset();
+  // The clear regions were computed for the size the frame was converted
+  // with, after a resize everything is cleared
+  auto target = ctx.targetSize();
+  if (target.w != frame.framebuffer.w || target.h != frame.framebuffer.h) {
+    ctx.fillAll(clear_color);
+  } else {
+    for (auto const &region : frame.clear_regions) {
+      ctx.fillRect(region, clear_color);
+    }
+  }
+  for (std::size_t n = 0; n != frame.lists.size(); ++n) {
+    auto start =
+        costs != nullptr ? clock_type::now() : clock_type::time_point{};
+    for (auto const &cmd : frame.lists[n]) {
+      state.clip(cmd.first);
+      draw(state, cmd.second);
+    }
+    if (costs != nullptr && n < costs->size()) {
+      (*costs)[n].raster_us = elapsed_us(start, clock_type::now());
+    }
+  }
+  state.clip(std::nullopt);
+  IMX_ZONE_VALUE(state.redundant());
 }
 
 imblend_context::imblend_context(std::string_view font_filename,
                                  ImVec4 clear_color,
                                  BLContextCreateInfo context_creation_info,
-                                 BLImageData shared_image_data)
+                                 BLImageData shared_image_data,
+                                 renderer_options const &options)
     : data(shared_image_data), info(context_creation_info),
-      clear_color(clear_color) {
+      clear_color(clear_color), font_atlas(options.font_atlas),
+      profiler_frame_images(options.profiler_frame_images) {
   ImGuiIO &io = ImGui::GetIO();
   auto &style = ImGui::GetStyle();
   ImFont *fnt = io.Fonts->AddFontFromFileTTF(font_filename.data(), 24);
+  if (fnt == nullptr) {
+    fmt::print("Failed to load a font from {}\n", font_filename);
+    std::terminate();
+  }
   io.FontDefault = fnt;
   ImFontConfig fontConfig;
   fontConfig.GlyphMinAdvanceX = 1.0f;
   fontConfig.SizePixels = 24.00;
   io.Fonts->AddFontDefault(&fontConfig);
   io.FontGlobalScale = 1.;
-  // Build atlas
+  // Build atlas, or restore it from the cache of an earlier run
+  std::string cache_path(options.font_atlas_cache);
+  bool cached = !cache_path.empty() && load_atlas_cache(*io.Fonts, cache_path);
+  // Glyphs are drawn from their outlines and everything else atlas textured
+  // is filled with a flat colour, so the pixels are never sampled and the
+  // RGBA32 copy ImGui would make for a backend is not needed
   unsigned char *tex_pixels = nullptr;
   int tex_w = 0;
   int tex_h = 0;
-  io.Fonts->GetTexDataAsRGBA32(&tex_pixels, &tex_w, &tex_h);
-
-  for (auto const &character : fnt->IndexLookup) {
-    const auto *glyph = fnt->FindGlyph(character);
-    if (glyph == nullptr) {
-      fmt::print("Failed to find glyph for {}\n", character);
-      std::terminate();
-    }
-
-    std::uint64_t uv = uv_to_key(glyph->U0, glyph->V0);
-    face_offset offset{character, 0, 0};
-    std::tie(offset.x, offset.y) =
-        get_glyph_offset(glyph, fontConfig.SizePixels);
-    g_font_look_up[uv] = offset;
+  io.Fonts->GetTexDataAsAlpha8(&tex_pixels, &tex_w, &tex_h);
+  if (!cache_path.empty() && !cached) {
+    save_atlas_cache(*io.Fonts, cache_path);
   }
-  textures.reserve(1024);
-
-  BLImage &fonts = textures.emplace_back(tex_w, tex_h, BL_FORMAT_PRGB32);
-  fonts.createFromData(tex_w, tex_h, BL_FORMAT_PRGB32, tex_pixels, 4 * tex_w);
-  // fonts.writeToFile("fonts.png");
-  ImTextureID font_texture = ImGui::GetIO().Fonts->TexID;
-
-  img.createFromData(shared_image_data.size.w, shared_image_data.size.w,
-                     BL_FORMAT_PRGB32, shared_image_data.pixelData,
-                     shared_image_data.stride);
-
-  BLFontFace face;
-  if (face.createFromFile(font_filename.data()) != BL_SUCCESS) {
+  build_font_look_up(*io.Fonts, fonts);
+  if (fonts.faces() == 0) {
     fmt::print("Failed to load a font face from {}\n", font_filename);
     std::terminate();
   }
-
-  if (font.createFromFace(face, fontConfig.SizePixels) != BL_SUCCESS) {
-    fmt::print("Failed to create font from {}\n", font_filename);
-    std::terminate();
+  // Glyph identification only needs the uvs, which ImGui keeps
+  if (font_atlas == font_atlas_mode::none) {
+    io.Fonts->ClearTexData();
   }
-}
+  ImTextureID font_texture = ImGui::GetIO().Fonts->TexID;
 
-bool initialize_platform() {
-  static std::unique_ptr<imx_context> s_context;
-  if (s_context) {
-    fmt::print("ImX context already initialized\n");
-    return false;
-  }
-  s_context = std::make_unique<imx_context>();
-  ImGui::GetIO().BackendPlatformUserData = s_context.get();
-  return true;
+  img.createFromData(shared_image_data.size.w, shared_image_data.size.h,
+                     BL_FORMAT_PRGB32, shared_image_data.pixelData,
+                     shared_image_data.stride);
 }
 
 bool initialize_renderer(std::string_view font_filename, ImVec4 clear_color,
                          BLContextCreateInfo context_creation_info,
-                         BLImageData shared_image_data) {
+                         BLImageData shared_image_data,
+                         renderer_options const &options) {
   static std::unique_ptr<imblend_context> s_context;
   if (s_context == nullptr) {
-    s_context = std::make_unique<imblend_context>(
-        font_filename, clear_color, context_creation_info, shared_image_data);
+    s_context = std::make_unique<imblend_context>(font_filename, clear_color,
+                                                  context_creation_info,
+                                                  shared_image_data, options);
     ImGui::GetIO().BackendRendererUserData = s_context.get();
     ImGuiIO &io = ImGui::GetIO();
     io.DisplaySize = ImVec2(shared_image_data.size.w, shared_image_data.size.h);
@@ -658,18 +1241,71 @@ bool initialize_renderer(std::string_view font_filename, ImVec4 clear_color,
 
 bool initialize(std::string_view font_filename, ImVec4 clear_color,
                 BLContextCreateInfo context_creation_info,
-                BLImageData shared_image_data) {
-  return initialize_platform() &&
+                BLImageData shared_image_data,
+                renderer_options const &options) {
+  return initialize_platform(options) &&
          initialize_renderer(font_filename, clear_color, context_creation_info,
-                             shared_image_data);
+                             shared_image_data, options);
+}
+
+bool initialize_headless(std::string_view font_filename, BLImageData target,
+                         ImVec4 clear_color,
+                         BLContextCreateInfo context_creation_info,
+                         renderer_options const &options) {
+  return initialize_renderer(font_filename, clear_color, context_creation_info,
+                             target, options);
+}
+
+// Binds the context to the pixels of a window image or of the caller. The
+// context stays bound across frames and is only rebound when the pixels
+// change.
+bool bind_target(imblend_context &context, BLImageData const &target) {
+  auto &bound = context.data;
+  if (context.ctx.isValid() && bound.pixelData == target.pixelData &&
+      bound.size.w == target.size.w && bound.size.h == target.size.h &&
+      bound.stride == target.stride) {
+    return true;
+  }
+  IMX_ZONE(stage);
+  context.ctx.end();
+  if (context.img.createFromData(target.size.w, target.size.h,
+                                 BL_FORMAT_PRGB32, target.pixelData,
+                                 target.stride) != BL_SUCCESS ||
+      context.ctx.begin(context.img, context.info) != BL_SUCCESS) {
+    fmt::print("Failed to begin render with new shared image data\n");
+    bound = BLImageData{};
+    return false;
+  }
+  bound = target;
+  bound.format = BL_FORMAT_PRGB32;
+  ImGui::GetIO().DisplaySize = ImVec2(target.size.w, target.size.h);
+  return true;
+}
+
+bool set_render_target(BLImageData target) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return bind_target(*data, target);
+  }
+  return false;
 }
 
 bool begin_frame() {
-  ZoneScoped;
+  IMX_ZONE(frame);
   auto &io = ImGui::GetIO();
   if (auto *data = static_cast<imblend_context *>(io.BackendRendererUserData)) {
-    if (data->ctx.begin(data->img, data->info) == BL_SUCCESS) {
-      auto &io = ImGui::GetIO();
+    // Windows start the next frame once the last one was presented
+    if (auto presented = take_present_time()) {
+      data->stats.present_us = *presented;
+      data->present_times.add(*presented);
+    }
+    // The context is bound once and kept, window images are bound by
+    // end_frame and an image shared at initialization on first use
+    if (!data->ctx.isValid() && !data->img.empty() &&
+        data->ctx.begin(data->img, data->info) != BL_SUCCESS) {
+      return false;
+    }
+    if (data->ctx.isValid()) {
       io.DisplaySize = ImVec2(data->img.width(), data->img.height());
       return true;
     }
@@ -677,66 +1313,408 @@ bool begin_frame() {
   return false;
 }
 
+std::size_t draw_data_bytes(std::vector<draw_list> const &lists);
+
+bool convert_frame(frame_data &frame, ImDrawData const *draw_data) {
+  IMX_ZONE(stage);
+  if (auto *context = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    auto start = clock_type::now();
+    context->textures.next_frame();
+    context->gradient_styles.next_frame();
+    context->glyphs.next_frame();
+    context->text_runs.next_frame(context->glyphs.generation());
+    frame.framebuffer =
+        BLRect(draw_data->DisplayPos.x, draw_data->DisplayPos.y,
+               draw_data->DisplaySize.x, draw_data->DisplaySize.y);
+    process_draw_data(frame.lists, draw_data, &frame.counts, &frame.costs);
+    context->glyphs.commit();
+    cull_occluded(frame);
+    if (context->batch_window > 1) {
+      IMX_ZONE_NAMED(stage, "batch states");
+      for (auto &list : frame.lists) {
+        for (auto &cmd : list) {
+          batch_states(cmd.second, context->batch_window);
+        }
+      }
+    }
+    frame.convert_us = elapsed_us(start, clock_type::now());
+    if constexpr (instrumented(instrumentation::stage)) {
+      auto bytes = draw_data_bytes(frame.lists);
+      track_memory(&frame, frame.tracked_bytes, bytes, "imx conversion");
+      frame.tracked_bytes = bytes;
+    }
+    return true;
+  }
+  return false;
+}
+
 bool draw_frame(ImDrawData const *draw_data, ImVec4 clear_color) {
-  ZoneScoped;
+  IMX_ZONE(frame);
   if (auto *context = static_cast<imblend_context *>(
           ImGui::GetIO().BackendRendererUserData)) {
     if (clear_color.x != IMX_NO_COLOR.x || clear_color.y != IMX_NO_COLOR.y ||
         clear_color.z != IMX_NO_COLOR.z || clear_color.w != IMX_NO_COLOR.w) {
       context->clear_color = clear_color;
     }
-    process_draw_data(context->draw_buffers[context->buffer % 2], draw_data);
+    if (context->capture.is_open()) {
+      context->capture.write(*draw_data);
+    }
+    convert_frame(context->draw_buffers[context->buffer % 2], draw_data);
+    frame_converted();
     enqueue_expose();
     return true;
   }
   return false;
 }
 
-IMX_API bool end_frame(BLContextFlushFlags flags) {
-  ZoneScoped;
-  auto &io = ImGui::GetIO();
+// Shades the area of every draw list by its share of the most expensive
+// list of the frame, drawn over the frame after it was rendered
+void draw_cost_overlay(imblend_context &context,
+                       std::vector<draw_list_cost> const &costs) {
+  IMX_ZONE(stage);
+  double most = 0;
+  for (auto const &cost : costs) {
+    most = std::max(most, cost.convert_us + cost.raster_us);
+  }
+  if (most <= 0) {
+    return;
+  }
+  auto &ctx = context.ctx;
+  ctx.save();
+  ctx.setCompOp(BL_COMP_OP_SRC_OVER);
+  ctx.setStrokeWidth(1);
+  BLFont const *font = context.fonts.get(0, 0.6F);
+  for (auto const &cost : costs) {
+    if (is_empty(cost.bounds)) {
+      continue;
+    }
+    auto us = cost.convert_us + cost.raster_us;
+    auto share = us / most;
+    auto red =
+        static_cast<std::uint32_t>(std::lround(255 * std::min(1.0, share * 2)));
+    auto green = static_cast<std::uint32_t>(
+        std::lround(255 * std::min(1.0, (1 - share) * 2)));
+    auto alpha = static_cast<std::uint32_t>(std::lround(32 + 96 * share));
+    ctx.fillRect(cost.bounds, BLRgba32(red, green, 0, alpha));
+    ctx.strokeRect(cost.bounds, BLRgba32(red, green, 0, 255));
+    if (font != nullptr) {
+      auto label = fmt::format("{} {:.0f} us", cost.name, us);
+      BLPoint pen(cost.bounds.x + 4,
+                  cost.bounds.y + font->metrics().ascent + 2);
+      ctx.fillUtf8Text(pen, *font, label.c_str(), label.size(),
+                       BLRgba32(0xFFFFFFFFU));
+    }
+  }
+  ctx.restore();
+}
+
+// Tracy takes RGBA frame images with sides divisible by 4 and compresses
+// them on its own thread, a small copy keeps that cheap
+void send_frame_image(imblend_context &context) {
+  static constexpr int s_max_width = 320;
+  IMX_ZONE(frame);
+  if (context.img.empty()) {
+    return;
+  }
+  auto scale = std::min(1.0, static_cast<double>(s_max_width) /
+                                 static_cast<double>(context.img.width()));
+  auto width = static_cast<int>(context.img.width() * scale) / 4 * 4;
+  auto height = static_cast<int>(context.img.height() * scale) / 4 * 4;
+  if (width == 0 || height == 0) {
+    return;
+  }
+  auto &image = context.frame_image;
+  if (image.width() != width || image.height() != height) {
+    image.create(width, height, BL_FORMAT_PRGB32);
+  }
+  BLContext ctx(image, BLContextCreateInfo{});
+  ctx.setCompOp(BL_COMP_OP_SRC_COPY);
+  ctx.blitImage(BLRect(0, 0, width, height), context.img);
+  ctx.end();
+  BLImageData pixels{};
+  image.getData(&pixels);
+  // PRGB32 is BGRA in memory
+  for (int y = 0; y < height; ++y) {
+    auto *row = static_cast<std::uint8_t *>(pixels.pixelData) +
+                static_cast<std::ptrdiff_t>(y) * pixels.stride;
+    for (int x = 0; x < width * 4; x += 4) {
+      std::swap(row[x], row[x + 2]);
+    }
+  }
+  IMX_FRAME_IMAGE(pixels.pixelData, static_cast<std::uint16_t>(width),
+                  static_cast<std::uint16_t>(height));
+}
+
+bool end_frame(BLContextFlushFlags flags) {
+  IMX_ZONE(frame);
   if (auto *data = static_cast<imblend_context *>(
           ImGui::GetIO().BackendRendererUserData)) {
-    if (auto *platform_data =
-            static_cast<imx_context *>(io.BackendPlatformUserData)) {
-      XSync(platform_data->display.get(), False);
-      for (auto &window : platform_data->windows) {
-        if (window.size_updates[0] != std::numeric_limits<int>::max()) {
-          auto width = std::numeric_limits<int>::max();
-          auto height = width;
-          std::swap(window.size_updates[0], width);
-          std::swap(window.size_updates[1], height);
-          window.image = std::make_unique<Image>(platform_data->display.get(),
-                                                 platform_data->visual, width,
-                                                 height, window.image->depth());
-          ImGui::GetIO().DisplaySize = ImVec2(width, height);
-        }
+    update_windows([data](void const *pixels) {
+      if (data->data.pixelData == pixels) {
+        data->ctx.end();
+        data->data = BLImageData{};
       }
-      auto &image = *platform_data->windows.front().image;
-      if (data->img.createFromData(image.width(), image.height(),
-                                   BL_FORMAT_PRGB32, image.data(),
-                                   image.stride()) != BL_SUCCESS) {
-        fmt::print("Failed to begin render with new shared image data\n");
-        return false;
+    });
+    if (auto target = window_target(); target && !bind_target(*data, *target)) {
+      return false;
+    }
+    IMX_ZONE_NAMED(stage, "Flush Context");
+    auto &frame = data->draw_buffers[data->buffer++ % 2];
+    auto start = clock_type::now();
+    render_frame(data->ctx, frame,
+                 as_rgba(ImGui::ColorConvertFloat4ToU32(data->clear_color)),
+                 &frame.costs);
+    auto rendered = clock_type::now();
+    if (data->cost_overlay) {
+      draw_cost_overlay(*data, frame.costs);
+    }
+    // The context is never ended, so the frame must be complete before the
+    // pixels are handed to the window system or the caller
+    auto result = data->ctx.flush(static_cast<BLContextFlushFlags>(
+                      flags | BL_CONTEXT_FLUSH_SYNC)) == BL_SUCCESS;
+    auto &stats = data->stats;
+    ++stats.frames;
+    stats.counts = frame.counts;
+    stats.convert_us = frame.convert_us;
+    stats.raster_us = elapsed_us(start, rendered);
+    stats.flush_us = elapsed_us(rendered, clock_type::now());
+    data->convert_times.add(stats.convert_us);
+    data->raster_times.add(stats.raster_us);
+    data->flush_times.add(stats.flush_us);
+    IMX_PLOT("imx shapes", stats.counts.shapes);
+    IMX_PLOT("imx glyphs", stats.counts.glyphs);
+    IMX_PLOT("imx edges", stats.counts.edges);
+    if constexpr (instrumented(instrumentation::frame)) {
+      if (data->profiler_frame_images) {
+        send_frame_image(*data);
       }
     }
-    ZoneScopedN("Flush Context");
-    render_frame(data->ctx, data->draw_buffers[data->buffer++ % 2],
-                 as_rgba(ImGui::ColorConvertFloat4ToU32(data->clear_color)));
-    auto result = data->ctx.flush(flags) == BL_SUCCESS;
     return result;
   }
   return false;
 }
 
-BLImage &add_texture() {
+texture_registry::texture_view use_texture(ImTextureID texture,
+                                           BLSize const &extent) {
   if (auto *data = static_cast<imblend_context *>(
           ImGui::GetIO().BackendRendererUserData)) {
-    return data->textures.emplace_back();
+    return data->textures.use(texture, extent);
+  }
+  return {};
+}
+
+glyph_cache *glyphs() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return &data->glyphs;
+  }
+  return nullptr;
+}
+
+gradient_cache *gradients() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return &data->gradient_styles;
+  }
+  return nullptr;
+}
+
+void set_state_batching(std::size_t window) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    data->batch_window = window;
+  }
+}
+
+std::size_t draw_data_bytes(std::vector<draw_list> const &lists) {
+  std::size_t result = lists.capacity() * sizeof(draw_list);
+  for (auto const &list : lists) {
+    result += list.capacity() * sizeof(draw_command);
+    for (auto const &cmd : list) {
+      result += cmd.second.capacity() * sizeof(shape);
+      for (auto const &s : cmd.second) {
+        if (auto const *poly = std::get_if<polygon>(&s)) {
+          result += (poly->points.capacity() + poly->uvs.capacity()) *
+                    sizeof(BLPoint);
+        } else if (auto const *outline = std::get_if<line>(&s)) {
+          result += outline->points.capacity() * sizeof(BLPoint);
+        }
+      }
+    }
+  }
+  return result;
+}
+
+renderer_memory get_renderer_memory() {
+  renderer_memory result{};
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    auto const *fonts = ImGui::GetIO().Fonts;
+    auto texels = static_cast<std::size_t>(fonts->TexWidth) *
+                  static_cast<std::size_t>(fonts->TexHeight);
+    result.font_atlas = (fonts->TexPixelsAlpha8 != nullptr ? texels : 0) +
+                        (fonts->TexPixelsRGBA32 != nullptr ? texels * 4 : 0);
+    // Tree nodes carry three pointers and a colour next to the value
+    result.glyph_lookup =
+        g_font_look_up.size() *
+        (sizeof(*g_font_look_up.begin()) + 4 * sizeof(void *));
+    result.glyph_cache = data->glyphs.stats().used_bytes;
+    result.text_runs = data->text_runs.bytes();
+    result.textures = data->textures.memory().used_bytes;
+    result.gradients = data->gradient_styles.bytes();
+    for (auto const &frame : data->draw_buffers) {
+      result.draw_data += draw_data_bytes(frame.lists) +
+                          frame.clear_regions.capacity() * sizeof(BLRect);
+    }
+  }
+  return result;
+}
+
+glyph_cache_stats get_glyph_cache_stats() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->glyphs.stats();
+  }
+  return {};
+}
+
+frame_stats get_frame_stats() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    auto result = data->stats;
+    result.convert = data->convert_times.percentiles();
+    result.raster = data->raster_times.percentiles();
+    result.flush = data->flush_times.percentiles();
+    result.present = data->present_times.percentiles();
+    return result;
+  }
+  return {};
+}
+
+std::vector<draw_list_cost> get_draw_list_costs() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    // end_frame moved on to the buffer draw_frame converts next
+    return data->draw_buffers[(data->buffer + 1) % 2].costs;
+  }
+  return {};
+}
+
+void set_cost_overlay(bool enabled) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    data->cost_overlay = enabled;
+  }
+}
+
+void set_glyph_cache_budget(std::size_t bytes) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    data->glyphs.set_budget(bytes);
+  }
+}
+
+bool start_capture(std::string_view path) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->capture.open(std::string(path), *ImGui::GetIO().Fonts);
+  }
+  return false;
+}
+
+void stop_capture() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    data->capture.close();
+  }
+}
+
+ImTextureID add_texture(BLImage const &image) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.add(image);
+  }
+  return nullptr;
+}
+
+ImTextureID load_texture_async(std::string_view path, bool memory_map) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.load(path, memory_map);
+  }
+  return nullptr;
+}
+
+void set_texture_placeholder(ImVec4 color) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    data->textures.set_placeholder(
+        as_rgba(ImGui::ColorConvertFloat4ToU32(color)));
+  }
+}
+
+bool update_texture(ImTextureID texture, BLImage const &image) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.update(texture, image);
+  }
+  return false;
+}
+
+bool retain_texture(ImTextureID texture) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.retain(texture);
+  }
+  return false;
+}
+
+bool remove_texture(ImTextureID texture) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.release(texture);
+  }
+  return false;
+}
+
+BLImage const *get_texture(ImTextureID texture) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.find(texture);
+  }
+  return nullptr;
+}
+
+bool set_texture_filter(ImTextureID texture, texture_filter filter) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.set_filter(texture, filter);
+  }
+  return false;
+}
+
+texture_info get_texture_info(ImTextureID texture) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.info(texture);
+  }
+  return {};
+}
+
+texture_memory get_texture_memory() {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    return data->textures.memory();
+  }
+  return {};
+}
+
+void set_texture_budget(std::size_t bytes) {
+  if (auto *data = static_cast<imblend_context *>(
+          ImGui::GetIO().BackendRendererUserData)) {
+    data->textures.set_budget(bytes);
   }
-  static BLImage invalid;
-  invalid.reset();
-  return invalid;
 }
 
 } // namespace imx
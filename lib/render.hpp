@@ -0,0 +1,141 @@
+#pragma once
+
+#include "glyph_cache.hpp"
+#include "imx/imx.hpp"
+#include <array>
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <imgui.h>
+#include <map>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
+
+// Stages of the renderer, shared with the benchmarks so each can be driven
+// without a window
+
+namespace imx {
+
+template <std::size_t N> struct text {
+  static constexpr std::size_t size = N;
+  std::array<ImWchar, N> chars;
+  BLPoint pt;
+  BLRgba32 color;
+  BLFont const *font;
+  std::uint32_t depth;
+  // Set when the glyph is drawn from the glyph atlas
+  std::optional<glyph_mask> mask;
+};
+
+struct polygon {
+  std::vector<BLPoint> points;
+  std::vector<BLPoint> uvs;
+  BLRgba32 color;
+  std::uint32_t depth;
+  ImTextureID texture;
+};
+
+// Axis aligned textured quad, typically from ImGui::Image, that can be
+// drawn as an image blit instead of a pattern fill
+struct image_quad {
+  BLRect rect;
+  BLRect uvs;
+  std::uint32_t depth;
+  ImTextureID texture;
+};
+
+// Rectangle with a different vertex colour in some of its corners, colors
+// are ordered top left, top right, bottom right and bottom left
+struct gradient_quad {
+  BLRect rect;
+  std::array<BLRgba32, 4> colors;
+  std::uint32_t depth;
+};
+
+// Triangle with interpolated vertex colours
+struct gradient_triangle {
+  std::array<BLPoint, 3> points;
+  std::array<BLRgba32, 3> colors;
+  std::uint32_t depth;
+};
+
+struct line {
+  std::vector<BLPoint> points;
+  BLRgba32 color;
+  float size;
+  std::uint32_t depth;
+};
+
+using shape = std::variant<text<1>, polygon, image_quad, gradient_quad,
+                           gradient_triangle, line>;
+
+using draw_command = std::pair<BLRect, std::vector<shape>>;
+using draw_list = std::vector<draw_command>;
+
+// Converted draw lists of one frame. clear_regions lists the parts of the
+// framebuffer not covered by opaque shapes, only these need clearing.
+struct frame_data {
+  std::vector<draw_list> lists;
+  BLRect framebuffer;
+  std::vector<BLRect> clear_regions;
+  frame_counts counts;
+  // One for each of lists
+  std::vector<draw_list_cost> costs;
+  double convert_us = 0;
+  // Size of the lists as last reported to the profiler
+  std::size_t tracked_bytes = 0;
+};
+
+struct edge_t {
+  ImDrawIdx p0;
+  ImDrawIdx p1;
+  ImU32 col;
+  std::uint32_t depth;
+  ImTextureID texture;
+};
+
+constexpr bool operator==(edge_t const &a, edge_t const &b) {
+  return a.p0 == b.p0 && a.p1 == b.p1;
+}
+
+constexpr bool operator<(edge_t const &a, edge_t const &b) {
+  if (a.p0 < b.p0)
+    return true;
+  if (a.p0 > b.p0)
+    return false;
+  return a.p1 > b.p1;
+}
+
+bool initialize_renderer(std::string_view font_filename, ImVec4 clear_color,
+                         BLContextCreateInfo context_creation_info,
+                         BLImageData shared_image_data,
+                         renderer_options const &options);
+
+// vtx is the top left and opposite the bottom right corner of a glyph quad
+bool create_glyph(std::vector<shape> &output, ImDrawVert const &vtx,
+                  ImDrawVert const &opposite, std::uint32_t current_depth);
+void generate_edges(std::map<edge_t, bool> &output, ImDrawIdx const *idx_buffer,
+                    ImDrawVert const *vtx_buffer, std::uint32_t start,
+                    std::uint32_t depth, ImTextureID texture);
+// Returns the number of outlines that could not be closed
+std::size_t generate_topology(std::vector<shape> &output,
+                              std::map<edge_t, bool> const &edges,
+                              ImDrawVert const *vtx_buffer);
+void process_draw_data(std::vector<draw_list> &blend_data,
+                       ImDrawData const *draw_data,
+                       frame_counts *counts = nullptr,
+                       std::vector<draw_list_cost> *costs = nullptr);
+void cull_occluded(frame_data &frame);
+void batch_states(std::vector<shape> &shapes, std::size_t window);
+// Converts draw data into frame the way draw_frame does, including the
+// per frame upkeep of the renderer caches
+bool convert_frame(frame_data &frame, ImDrawData const *draw_data);
+// Adds the raster time of every list to costs when given
+void render_frame(BLContext &ctx, frame_data const &frame,
+                  BLRgba32 clear_color,
+                  std::vector<draw_list_cost> *costs = nullptr);
+
+} // namespace imx
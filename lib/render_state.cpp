@@ -0,0 +1,59 @@
+#include "render_state.hpp"
+
+namespace imx {
+
+render_state::render_state(BLContext &ctx) : ctx_(ctx) {}
+
+void render_state::reset() {
+  ctx_.restoreClipping();
+  ctx_.setCompOp(BL_COMP_OP_SRC_OVER);
+  ctx_.setPatternQuality(BL_PATTERN_QUALITY_BILINEAR);
+  ctx_.resetTransform();
+  clip_.reset();
+  comp_op_ = BL_COMP_OP_SRC_OVER;
+  quality_ = BL_PATTERN_QUALITY_BILINEAR;
+  fill_.reset();
+}
+
+bool render_state::changed(bool differs) {
+  ++(differs ? changes_ : redundant_);
+  return differs;
+}
+
+void render_state::clip(std::optional<BLRect> const &rect) {
+  if (!changed(rect != clip_)) {
+    return;
+  }
+  // Clipping in Blend2D only ever narrows, a different clip has to start
+  // from the unclipped state
+  if (clip_) {
+    ctx_.restoreClipping();
+  }
+  if (rect) {
+    ctx_.clipToRect(*rect);
+  }
+  clip_ = rect;
+}
+
+void render_state::comp_op(BLCompOp op) {
+  if (changed(op != comp_op_)) {
+    ctx_.setCompOp(op);
+    comp_op_ = op;
+  }
+}
+
+void render_state::pattern_quality(BLPatternQuality quality) {
+  if (changed(quality != quality_)) {
+    ctx_.setPatternQuality(quality);
+    quality_ = quality;
+  }
+}
+
+void render_state::fill_style(BLRgba32 color) {
+  if (changed(fill_ != color)) {
+    ctx_.setFillStyle(color);
+    fill_ = color;
+  }
+}
+
+} // namespace imx
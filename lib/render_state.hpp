@@ -0,0 +1,44 @@
+#pragma once
+
+#include <blend2d.h>
+#include <cstddef>
+#include <optional>
+
+namespace imx {
+
+// Mirrors the state of a BLContext while a frame is rendered so that draw
+// code can ask for the state it needs and only actual changes reach the
+// context. Every state change of the renderer must go through here or the
+// mirror no longer matches the context.
+struct render_state {
+  explicit render_state(BLContext &ctx);
+
+  // Puts the context into a known state, called at the start of a frame
+  void reset();
+
+  // An empty optional removes the clip
+  void clip(std::optional<BLRect> const &rect);
+  void comp_op(BLCompOp op);
+  void pattern_quality(BLPatternQuality quality);
+  // Solid fill used by the fill calls that take no explicit style
+  void fill_style(BLRgba32 color);
+
+  [[nodiscard]] BLContext &context() { return ctx_; }
+  // Number of state changes forwarded to the context and avoided
+  [[nodiscard]] std::size_t changes() const { return changes_; }
+  [[nodiscard]] std::size_t redundant() const { return redundant_; }
+
+private:
+  bool changed(bool differs);
+
+  BLContext &ctx_;
+  std::optional<BLRect> clip_;
+  BLCompOp comp_op_ = BL_COMP_OP_SRC_OVER;
+  BLPatternQuality quality_ = BL_PATTERN_QUALITY_BILINEAR;
+  // Empty until the first solid fill of the frame
+  std::optional<BLRgba32> fill_;
+  std::size_t changes_ = 0;
+  std::size_t redundant_ = 0;
+};
+
+} // namespace imx
@@ -0,0 +1,74 @@
+#include "text_run_cache.hpp"
+#include "instrumentation.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace imx {
+
+namespace {
+
+// Windows that are hidden for a moment keep their runs
+constexpr std::uint64_t s_max_age = 120;
+
+// Compared bitwise like the hash, so the comparison agrees with it
+bool same_run(run_key const &a, run_key const &b) {
+  return a.color == b.color &&
+         std::memcmp(&a.subpixel, &b.subpixel, sizeof(ImVec2)) == 0 &&
+         a.quads.size() == b.quads.size() &&
+         std::memcmp(a.quads.data(), b.quads.data(),
+                     a.quads.size() * sizeof(run_quad)) == 0;
+}
+
+} // namespace
+
+std::vector<run_glyph> const *text_run_cache::find(run_key const &key) {
+  auto found = runs_.find(key.hash);
+  if (found == runs_.end() || !same_run(found->second.key, key)) {
+    ++misses_;
+    return nullptr;
+  }
+  ++hits_;
+  found->second.last_used = frame_;
+  return &found->second.glyphs;
+}
+
+std::vector<run_glyph> const *
+text_run_cache::insert(run_key const &key, std::vector<run_glyph> glyphs) {
+  // A colliding run replaces the one stored under the same hash
+  auto &slot = runs_[key.hash];
+  slot.key = key;
+  slot.glyphs = std::move(glyphs);
+  slot.last_used = frame_;
+  return &slot.glyphs;
+}
+
+std::size_t text_run_cache::bytes() const {
+  std::size_t result = 0;
+  for (auto const &[key, run] : runs_) {
+    result += sizeof(*runs_.begin()) +
+              run.key.quads.capacity() * sizeof(run_quad) +
+              run.glyphs.capacity() * sizeof(run_glyph);
+  }
+  return result;
+}
+
+void text_run_cache::next_frame(std::size_t glyph_generation) {
+  IMX_ZONE(stage);
+  ++frame_;
+  if (glyph_generation != generation_) {
+    generation_ = glyph_generation;
+    runs_.clear();
+    return;
+  }
+  for (auto it = runs_.begin(); it != runs_.end();) {
+    if (it->second.last_used + s_max_age < frame_) {
+      it = runs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+} // namespace imx
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "glyph_cache.hpp"
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <imgui.h>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace imx {
+
+// Glyph of a cached text run. Pen and mask origin are relative to the first
+// vertex of the run rounded down to whole pixels.
+struct run_glyph {
+  ImWchar c;
+  BLPoint pen;
+  BLFont const *font;
+  std::optional<glyph_mask> mask;
+};
+
+// Glyph quad of a text run relative to the first vertex of the run
+struct run_quad {
+  ImVec2 uv;
+  ImVec2 offset;
+  ImVec2 size;
+};
+
+// Everything a text run is identified by: its glyph quads, its colour and
+// the subpixel part of its position, so moved runs still hit. The hash
+// selects the entry and the rest is compared on a hit, so a hash collision
+// is a miss instead of drawing the glyphs of another run.
+struct run_key {
+  std::uint64_t hash = 0;
+  ImU32 color = 0;
+  ImVec2 subpixel;
+  std::vector<run_quad> quads;
+};
+
+// Remembers the glyphs ImGui text runs resolved to so a run seen in an
+// earlier frame, a label or a menu item, is converted without looking up
+// its glyphs again. Runs not drawn for a while are dropped.
+struct text_run_cache {
+  // nullptr when the run is unknown
+  std::vector<run_glyph> const *find(run_key const &key);
+  // An empty run marks a run that can not be drawn as glyphs
+  std::vector<run_glyph> const *insert(run_key const &key,
+                                       std::vector<run_glyph> glyphs);
+
+  // Glyph masks of cached runs are only valid for the glyph atlas
+  // generation they were created with
+  void next_frame(std::size_t glyph_generation);
+
+  [[nodiscard]] std::size_t runs() const { return runs_.size(); }
+  [[nodiscard]] std::size_t bytes() const;
+  [[nodiscard]] std::size_t hits() const { return hits_; }
+  [[nodiscard]] std::size_t misses() const { return misses_; }
+
+private:
+  struct entry {
+    run_key key;
+    std::vector<run_glyph> glyphs;
+    std::uint64_t last_used = 0;
+  };
+
+  std::unordered_map<std::uint64_t, entry> runs_;
+  std::uint64_t frame_ = 0;
+  std::size_t generation_ = 0;
+  std::size_t hits_ = 0;
+  std::size_t misses_ = 0;
+};
+
+} // namespace imx
@@ -0,0 +1,390 @@
+#include "texture_registry.hpp"
+#include "instrumentation.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <thread>
+#include <utility>
+
+namespace imx {
+
+namespace {
+
+static_assert(sizeof(std::uintptr_t) >= sizeof(std::uint64_t),
+              "texture handles require 64 bit pointers");
+
+// Slot 0 is never handed out so a null ImTextureID is always invalid
+ImTextureID encode(std::uint32_t index, std::uint32_t generation) {
+  return reinterpret_cast<ImTextureID>(static_cast<std::uintptr_t>(
+      (static_cast<std::uint64_t>(generation) << 32U) | (index + 1U)));
+}
+
+std::uint32_t decode_index(ImTextureID texture) {
+  return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(texture) &
+                                    0xFFFFFFFFU) -
+         1U;
+}
+
+std::uint32_t decode_generation(ImTextureID texture) {
+  return static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(texture) >>
+                                    32U);
+}
+
+// Pool the pixels of textures are reported in to the profiler
+constexpr char const *s_memory_pool = "imx textures";
+
+std::size_t image_bytes(BLImage const &image) {
+  BLImageData data{};
+  if (image.empty() || image.getData(&data) != BL_SUCCESS) {
+    return 0;
+  }
+  return static_cast<std::size_t>(std::abs(data.stride)) *
+         static_cast<std::size_t>(data.size.h);
+}
+
+constexpr std::size_t s_max_levels = 16;
+
+std::size_t worker_count() {
+  auto hardware = static_cast<std::size_t>(std::thread::hardware_concurrency());
+  return std::clamp<std::size_t>(hardware / 2, 1, 4);
+}
+
+// Index of the smallest level that is still at least extent large
+std::size_t level_for(BLImage const &image, BLSize const &extent) {
+  if (extent.w <= 0 || extent.h <= 0) {
+    return 0;
+  }
+  auto scale = std::max(extent.w / image.width(), extent.h / image.height());
+  if (scale > 0.5) {
+    return 0;
+  }
+  // Levels stop at a single pixel
+  auto deepest = static_cast<std::size_t>(
+      std::log2(std::max(image.width(), image.height())));
+  auto level = static_cast<std::size_t>(std::floor(std::log2(1.0 / scale)));
+  return std::min({level, deepest, s_max_levels});
+}
+
+BLImage downscale(BLImage const &source) {
+  IMX_ZONE(stage);
+  auto width = std::max(1, (source.width() + 1) / 2);
+  auto height = std::max(1, (source.height() + 1) / 2);
+  BLImage result(width, height, source.format());
+  BLContext ctx(result, BLContextCreateInfo{});
+  ctx.setCompOp(BL_COMP_OP_SRC_COPY);
+  ctx.setPatternQuality(BL_PATTERN_QUALITY_BILINEAR);
+  ctx.blitImage(BLRect(0, 0, width, height), source);
+  ctx.end();
+  return result;
+}
+
+bool read_image(BLImage &image, std::string const &path, bool memory_map) {
+  IMX_ZONE(stage);
+  if (!memory_map) {
+    return image.readFromFile(path.c_str()) == BL_SUCCESS;
+  }
+  mapped_file file(path);
+  return file.data != nullptr &&
+         image.readFromData(file.data, file.size) == BL_SUCCESS;
+}
+
+} // namespace
+
+texture_registry::texture_registry() : workers_(worker_count()) {}
+
+texture_registry::entry *texture_registry::lookup(ImTextureID texture) {
+  return const_cast<entry *>(
+      static_cast<texture_registry const *>(this)->lookup(texture));
+}
+
+texture_registry::entry const *
+texture_registry::lookup(ImTextureID texture) const {
+  if (texture == nullptr) {
+    return nullptr;
+  }
+  auto index = decode_index(texture);
+  if (index >= entries_.size()) {
+    return nullptr;
+  }
+  auto const &slot = entries_[index];
+  if (slot.references == 0 || slot.generation != decode_generation(texture)) {
+    return nullptr;
+  }
+  return &slot;
+}
+
+void texture_registry::assign(entry &slot, BLImage const &image) {
+  used_ -= slot.bytes;
+  auto before = slot.bytes;
+  slot.image = image;
+  slot.levels.clear();
+  slot.bytes = image_bytes(image);
+  track_memory(&slot, before, slot.bytes, s_memory_pool);
+  // Any levels still being generated belong to the previous image
+  ++slot.version;
+  slot.generating = false;
+  slot.loading = false;
+  used_ += slot.bytes;
+}
+
+ImTextureID texture_registry::add(BLImage const &image) {
+  IMX_ZONE(stage);
+  std::uint32_t index = 0;
+  if (free_.empty()) {
+    index = static_cast<std::uint32_t>(entries_.size());
+    entries_.emplace_back();
+  } else {
+    index = free_.back();
+    free_.pop_back();
+  }
+  auto &slot = entries_[index];
+  slot.references = 1;
+  slot.last_used = frame_;
+  assign(slot, image);
+  return encode(index, slot.generation);
+}
+
+ImTextureID texture_registry::load(std::string_view path, bool memory_map) {
+  auto texture = add(BLImage{});
+  auto &slot = *lookup(texture);
+  slot.path = path;
+  slot.memory_map = memory_map;
+  load_image(texture, slot);
+  return texture;
+}
+
+void texture_registry::load_image(ImTextureID texture, entry &slot) {
+  slot.loading = true;
+  slot.failed = false;
+  workers_.enqueue([this, texture, version = slot.version, path = slot.path,
+                    memory_map = slot.memory_map]() {
+    IMX_ZONE_NAMED(stage, "load texture");
+    loaded_image result{texture, version, BLImage{}, false};
+    result.success = read_image(result.image, path, memory_map);
+    std::lock_guard<std::mutex> lock(generated_mutex_);
+    loaded_.push_back(std::move(result));
+  });
+}
+
+bool texture_registry::update(ImTextureID texture, BLImage const &image) {
+  if (auto *slot = lookup(texture)) {
+    assign(*slot, image);
+    return true;
+  }
+  return false;
+}
+
+bool texture_registry::retain(ImTextureID texture) {
+  if (auto *slot = lookup(texture)) {
+    ++slot->references;
+    return true;
+  }
+  return false;
+}
+
+bool texture_registry::release(ImTextureID texture) {
+  if (auto *slot = lookup(texture)) {
+    if (--slot->references == 0) {
+      assign(*slot, BLImage{});
+      slot->path.clear();
+      slot->failed = false;
+      ++slot->generation;
+      free_.push_back(decode_index(texture));
+    }
+    return true;
+  }
+  return false;
+}
+
+bool texture_registry::set_filter(ImTextureID texture,
+                                  texture_filter filter) {
+  if (auto *slot = lookup(texture)) {
+    slot->filter = filter;
+    return true;
+  }
+  return false;
+}
+
+BLImage const *texture_registry::find(ImTextureID texture) const {
+  if (auto const *slot = lookup(texture)) {
+    if (!slot->image.empty()) {
+      return &slot->image;
+    }
+  }
+  return nullptr;
+}
+
+texture_registry::texture_view
+texture_registry::use(ImTextureID texture, BLSize const &extent) {
+  texture_view view{};
+  if (auto *slot = lookup(texture)) {
+    slot->last_used = frame_;
+    if (slot->image.empty()) {
+      if (!slot->path.empty() && !slot->loading && !slot->failed) {
+        load_image(texture, *slot);
+      }
+      view.pending = slot->loading;
+      view.placeholder = placeholder_;
+      return view;
+    }
+    view.filter = slot->filter;
+    view.image = &slot->image;
+    auto level = level_for(slot->image, extent);
+    if (level > slot->levels.size()) {
+      generate_levels(texture, *slot, level);
+    }
+    if (level != 0 && !slot->levels.empty()) {
+      view.image = &slot->levels[std::min(level, slot->levels.size()) - 1];
+    }
+  }
+  return view;
+}
+
+void texture_registry::generate_levels(ImTextureID texture, entry &slot,
+                                       std::size_t level) {
+  // Only one job per texture at a time, a deeper level still missing once
+  // it completes is requested again the next time the texture is drawn
+  if (slot.generating) {
+    return;
+  }
+  slot.generating = true;
+  auto first = slot.levels.size() + 1;
+  BLImage source = slot.levels.empty() ? slot.image : slot.levels.back();
+  workers_.enqueue([this, texture, version = slot.version, first, level,
+                    source = std::move(source)]() {
+    IMX_ZONE_NAMED(stage, "generate texture levels");
+    generated_levels result{texture, version, first, {}};
+    BLImage current = source;
+    for (auto idx = first; idx <= level; ++idx) {
+      if (current.width() == 1 && current.height() == 1) {
+        break;
+      }
+      current = downscale(current);
+      result.levels.push_back(current);
+    }
+    std::lock_guard<std::mutex> lock(generated_mutex_);
+    generated_.push_back(std::move(result));
+  });
+}
+
+void texture_registry::publish() {
+  std::vector<generated_levels> generated;
+  std::vector<loaded_image> loaded;
+  {
+    std::lock_guard<std::mutex> lock(generated_mutex_);
+    std::swap(generated, generated_);
+    std::swap(loaded, loaded_);
+  }
+  for (auto &result : loaded) {
+    auto *slot = lookup(result.texture);
+    // Removed or replaced by update while loading
+    if (slot == nullptr || slot->version != result.version) {
+      continue;
+    }
+    if (result.success) {
+      assign(*slot, result.image);
+    } else {
+      fmt::print("Failed to load texture from {}\n", slot->path);
+      slot->loading = false;
+      slot->failed = true;
+    }
+  }
+  for (auto &result : generated) {
+    auto *slot = lookup(result.texture);
+    if (slot == nullptr || slot->version != result.version) {
+      continue;
+    }
+    slot->generating = false;
+    // Evicted while the job was running
+    if (slot->image.empty() || result.first != slot->levels.size() + 1) {
+      continue;
+    }
+    auto before = slot->bytes;
+    for (auto &level : result.levels) {
+      auto bytes = image_bytes(level);
+      slot->bytes += bytes;
+      used_ += bytes;
+      slot->levels.push_back(std::move(level));
+    }
+    track_memory(slot, before, slot->bytes, s_memory_pool);
+  }
+}
+
+texture_info texture_registry::info(ImTextureID texture) const {
+  texture_info result{};
+  if (auto const *slot = lookup(texture)) {
+    result.width = slot->image.width();
+    result.height = slot->image.height();
+    result.bytes = slot->bytes;
+    result.references = slot->references;
+    result.last_used_frame = slot->last_used;
+    result.filter = slot->filter;
+    result.resident = !slot->image.empty();
+    result.loading = slot->loading;
+    result.failed = slot->failed;
+  }
+  return result;
+}
+
+texture_memory texture_registry::memory() const {
+  texture_memory result{};
+  result.used_bytes = used_;
+  result.budget_bytes = budget_;
+  result.evictions = evictions_;
+  for (auto const &slot : entries_) {
+    if (slot.references != 0) {
+      ++result.textures;
+      if (!slot.image.empty()) {
+        ++result.resident;
+      }
+    }
+  }
+  return result;
+}
+
+void texture_registry::set_budget(std::size_t bytes) {
+  budget_ = bytes;
+  evict();
+}
+
+void texture_registry::set_placeholder(BLRgba32 color) {
+  placeholder_ = color;
+}
+
+void texture_registry::next_frame() {
+  publish();
+  ++frame_;
+  evict();
+}
+
+void texture_registry::evict() {
+  if (budget_ == 0 || used_ <= budget_) {
+    return;
+  }
+  IMX_ZONE(stage);
+  std::vector<entry *> candidates;
+  for (auto &slot : entries_) {
+    // Anything drawn in the previous frame is likely on screen right now
+    if (slot.references != 0 && slot.bytes != 0 &&
+        slot.last_used + 1 < frame_) {
+      candidates.push_back(&slot);
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(),
+            [](auto const *a, auto const *b) {
+              return a->last_used < b->last_used;
+            });
+  for (auto *slot : candidates) {
+    if (used_ <= budget_) {
+      break;
+    }
+    assign(*slot, BLImage{});
+    ++evictions_;
+  }
+}
+
+} // namespace imx
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "imx/texture.hpp"
+#include "worker_pool.hpp"
+#include <blend2d.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <imgui.h>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace imx {
+
+// Owns all user textures. Handles encode a slot index and a generation so a
+// removed texture can never alias a texture added later into the same slot.
+// Entries live in a deque so pointers to resident images stay valid while
+// other textures are added.
+//
+// Textures loaded from files are decoded by background workers and are
+// published on next_frame, the same mechanism reloads them after eviction.
+//
+// Textures drawn at less than half their size are sampled from a chain of
+// pre-scaled levels, level n being the source halved n times. Levels are
+// generated on demand by background workers and published on next_frame.
+struct texture_registry {
+  struct entry {
+    BLImage image;
+    std::vector<BLImage> levels;
+    std::string path;
+    std::size_t bytes = 0;
+    std::uint32_t generation = 0;
+    std::uint32_t version = 0;
+    std::uint32_t references = 0;
+    std::uint64_t last_used = 0;
+    texture_filter filter = texture_filter::bilinear;
+    bool generating = false;
+    bool memory_map = false;
+    bool loading = false;
+    bool failed = false;
+  };
+
+  // image is nullptr when there is nothing to draw, pending is set if that
+  // is because the image is still being loaded
+  struct texture_view {
+    BLImage const *image = nullptr;
+    texture_filter filter = texture_filter::bilinear;
+    bool pending = false;
+    BLRgba32 placeholder{};
+  };
+
+  texture_registry();
+
+  ImTextureID add(BLImage const &image);
+  ImTextureID load(std::string_view path, bool memory_map);
+  bool update(ImTextureID texture, BLImage const &image);
+  bool retain(ImTextureID texture);
+  bool release(ImTextureID texture);
+  bool set_filter(ImTextureID texture, texture_filter filter);
+
+  [[nodiscard]] BLImage const *find(ImTextureID texture) const;
+  // Resolves a texture for drawing and marks it as used in the current
+  // frame. extent is the size the whole texture covers on screen and selects
+  // the smallest available level that is still at least that large. The view
+  // is empty unless the texture is resident.
+  texture_view use(ImTextureID texture, BLSize const &extent);
+
+  [[nodiscard]] texture_info info(ImTextureID texture) const;
+  [[nodiscard]] texture_memory memory() const;
+  void set_budget(std::size_t bytes);
+  void set_placeholder(BLRgba32 color);
+
+  // Publishes finished background work, advances the frame counter and
+  // evicts least recently used textures if the budget is exceeded
+  void next_frame();
+
+private:
+  struct generated_levels {
+    ImTextureID texture;
+    std::uint32_t version;
+    std::size_t first;
+    std::vector<BLImage> levels;
+  };
+
+  struct loaded_image {
+    ImTextureID texture;
+    std::uint32_t version;
+    BLImage image;
+    bool success;
+  };
+
+  entry *lookup(ImTextureID texture);
+  [[nodiscard]] entry const *lookup(ImTextureID texture) const;
+  void assign(entry &slot, BLImage const &image);
+  void generate_levels(ImTextureID texture, entry &slot, std::size_t level);
+  void load_image(ImTextureID texture, entry &slot);
+  void publish();
+  void evict();
+
+  std::deque<entry> entries_;
+  std::vector<std::uint32_t> free_;
+  std::size_t used_ = 0;
+  std::size_t budget_ = 0;
+  std::size_t evictions_ = 0;
+  std::uint64_t frame_ = 1;
+  BLRgba32 placeholder_{0x40808080};
+
+  std::mutex generated_mutex_;
+  std::vector<generated_levels> generated_;
+  std::vector<loaded_image> loaded_;
+  // Declared last so workers are joined before anything they touch is gone
+  worker_pool workers_;
+};
+
+} // namespace imx
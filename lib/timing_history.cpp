@@ -0,0 +1,27 @@
+#include "timing_history.hpp"
+#include <algorithm>
+#include <cstddef>
+
+namespace imx {
+
+void timing_history::add(double us) {
+  samples_[next_] = us;
+  next_ = (next_ + 1) % capacity;
+  count_ = std::min(count_ + 1, capacity);
+}
+
+timing_percentiles timing_history::percentiles() const {
+  if (count_ == 0) {
+    return {};
+  }
+  auto sorted = samples_;
+  auto end = sorted.begin() + static_cast<std::ptrdiff_t>(count_);
+  std::sort(sorted.begin(), end);
+  auto at = [&](double fraction) {
+    return sorted[static_cast<std::size_t>(fraction *
+                                           static_cast<double>(count_ - 1))];
+  };
+  return {at(0.5), at(0.95), at(0.99)};
+}
+
+} // namespace imx
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "imx/imx.hpp"
+#include <array>
+#include <chrono>
+#include <cstddef>
+
+namespace imx {
+
+using clock_type = std::chrono::steady_clock;
+
+inline double elapsed_us(clock_type::time_point start,
+                         clock_type::time_point end) {
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+// Durations of the most recent frames in a ring buffer. Adding a sample is
+// a store, the percentiles are only computed when asked for.
+struct timing_history {
+  static constexpr std::size_t capacity = 256;
+
+  void add(double us);
+  [[nodiscard]] timing_percentiles percentiles() const;
+
+private:
+  std::array<double, capacity> samples_{};
+  std::size_t count_ = 0;
+  std::size_t next_ = 0;
+};
+
+} // namespace imx
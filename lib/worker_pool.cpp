@@ -0,0 +1,51 @@
+#include "worker_pool.hpp"
+#include "instrumentation.hpp"
+#include <utility>
+
+namespace imx {
+
+worker_pool::worker_pool(std::size_t threads) {
+  threads_.reserve(threads);
+  for (std::size_t idx = 0; idx != threads; ++idx) {
+    threads_.emplace_back([this] { run(); });
+  }
+}
+
+worker_pool::~worker_pool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    jobs_.clear();
+  }
+  wake_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void worker_pool::enqueue(std::function<void()> job) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(std::move(job));
+  }
+  wake_.notify_one();
+}
+
+void worker_pool::run() {
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (stopping_) {
+        return;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    IMX_ZONE_NAMED(stage, "worker job");
+    job();
+  }
+}
+
+} // namespace imx
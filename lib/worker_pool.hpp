@@ -0,0 +1,36 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace imx {
+
+// Small fixed size thread pool for work that must stay off the UI thread.
+// Jobs still queued when the pool is destroyed are discarded, jobs already
+// running are waited for.
+struct worker_pool {
+  explicit worker_pool(std::size_t threads);
+  ~worker_pool();
+  worker_pool(worker_pool const &) = delete;
+  worker_pool &operator=(worker_pool const &) = delete;
+  worker_pool(worker_pool &&) noexcept = delete;
+  worker_pool &operator=(worker_pool &&) noexcept = delete;
+
+  void enqueue(std::function<void()> job);
+
+private:
+  void run();
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::deque<std::function<void()>> jobs_;
+  std::vector<std::thread> threads_;
+  bool stopping_ = false;
+};
+
+} // namespace imx
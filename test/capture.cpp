@@ -0,0 +1,225 @@
+#include "capture.hpp"
+#include "check.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <imgui.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Round trips synthetic draw data through capture_writer and capture_reader
+// and checks that damaged files are rejected
+
+namespace {
+
+using imx::test::check;
+
+// Offsets into a capture: the 24 byte header is followed by the 40 byte
+// record of the first frame, which starts with its list count, then by the
+// 16 byte record of the first list and its 40 byte command records, whose
+// vertex offset and element count are at 24 and 32. The five vertices of
+// the first list follow, padded to 8 bytes, and then its indices.
+constexpr std::size_t s_frame_lists_offset = 24;
+constexpr std::size_t s_list_commands_offset = 64;
+constexpr std::size_t s_first_command_offset = 80;
+constexpr std::size_t s_command_size = 40;
+constexpr std::size_t s_vtx_offset_offset = 24;
+constexpr std::size_t s_elem_count_offset = 32;
+constexpr std::size_t s_first_index_offset =
+    s_first_command_offset + 2 * s_command_size +
+    (5 * sizeof(ImDrawVert) + 7) / 8 * 8;
+
+ImTextureID texture(std::uintptr_t id) {
+  return reinterpret_cast<ImTextureID>(id);
+}
+
+void add_command(ImDrawList &list, ImVec4 clip, ImTextureID texture_id,
+                 unsigned int idx_offset, unsigned int elem_count) {
+  ImDrawCmd cmd{};
+  cmd.ClipRect = clip;
+  cmd.TextureId = texture_id;
+  cmd.IdxOffset = idx_offset;
+  cmd.ElemCount = elem_count;
+  list.CmdBuffer.push_back(cmd);
+}
+
+void add_vertices(ImDrawList &list, int count) {
+  for (int n = 0; n < count; ++n) {
+    auto x = static_cast<float>(n);
+    list.VtxBuffer.push_back(
+        ImDrawVert{ImVec2(x, 2 * x), ImVec2(x / 8, 1 - x / 8),
+                   0xff000000U | static_cast<ImU32>(n * 0x10203)});
+  }
+}
+
+void add_indices(ImDrawList &list, std::vector<ImDrawIdx> const &indices) {
+  for (auto index : indices) {
+    list.IdxBuffer.push_back(index);
+  }
+}
+
+struct scene {
+  scene() : first(nullptr), second(nullptr) {
+    add_command(first, ImVec4(0, 0, 640, 480), texture(0x10), 0, 3);
+    add_command(first, ImVec4(10, 20, 30, 40), texture(0x7f0000000020), 3, 3);
+    add_vertices(first, 5);
+    add_indices(first, {0, 1, 2, 2, 3, 4});
+    add_command(second, ImVec4(1.5F, 2.5F, 3.5F, 4.5F), texture(0x30), 0, 6);
+    add_vertices(second, 4);
+    add_indices(second, {0, 1, 2, 0, 2, 3});
+    data.CmdLists.push_back(&first);
+    data.CmdLists.push_back(&second);
+    data.CmdListsCount = 2;
+    data.DisplayPos = ImVec2(5, 6);
+    data.DisplaySize = ImVec2(640, 480);
+    data.FramebufferScale = ImVec2(2, 2);
+  }
+
+  ImDrawList first;
+  ImDrawList second;
+  ImDrawData data;
+};
+
+bool same(ImVec2 a, ImVec2 b) { return a.x == b.x && a.y == b.y; }
+
+bool same(ImVec4 a, ImVec4 b) {
+  return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+}
+
+template <typename T> bool same(ImVector<T> const &a, ImVector<T> const &b) {
+  auto bytes = sizeof(T) * static_cast<std::size_t>(a.Size);
+  return a.Size == b.Size && std::memcmp(a.Data, b.Data, bytes) == 0;
+}
+
+bool same_list(ImDrawList const &a, ImDrawList const &b) {
+  if (a.CmdBuffer.Size != b.CmdBuffer.Size) {
+    return false;
+  }
+  for (int n = 0; n < a.CmdBuffer.Size; ++n) {
+    auto const &x = a.CmdBuffer[n];
+    auto const &y = b.CmdBuffer[n];
+    if (!same(x.ClipRect, y.ClipRect) || x.TextureId != y.TextureId ||
+        x.VtxOffset != y.VtxOffset || x.IdxOffset != y.IdxOffset ||
+        x.ElemCount != y.ElemCount) {
+      return false;
+    }
+  }
+  return same(a.VtxBuffer, b.VtxBuffer) && same(a.IdxBuffer, b.IdxBuffer);
+}
+
+void check_frame(ImDrawData const *read, ImDrawData const &written) {
+  check(read != nullptr, "frame is read");
+  if (read == nullptr) {
+    return;
+  }
+  check(read->CmdListsCount == written.CmdListsCount, "list count matches");
+  check(same(read->DisplayPos, written.DisplayPos) &&
+            same(read->DisplaySize, written.DisplaySize) &&
+            same(read->FramebufferScale, written.FramebufferScale),
+        "display geometry matches");
+  if (read->CmdListsCount != written.CmdListsCount) {
+    return;
+  }
+  for (int n = 0; n < read->CmdListsCount; ++n) {
+    check(same_list(*read->CmdLists[n], *written.CmdLists[n]),
+          "commands, clip rects, texture ids, vertices and indices match");
+  }
+  check(read->TotalVtxCount == 9 && read->TotalIdxCount == 12,
+        "totals are counted");
+}
+
+std::vector<char> read_file(std::string const &path) {
+  std::ifstream in(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(in), {}};
+}
+
+void write_file(std::string const &path, std::vector<char> const &bytes) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+template <typename T>
+void patch(std::vector<char> &bytes, std::size_t offset, T value) {
+  std::memcpy(bytes.data() + offset, &value, sizeof(value));
+}
+
+// Writes original with one value replaced and checks that its first frame
+// is rejected
+template <typename T>
+void expect_rejected(std::string const &path, std::vector<char> original,
+                     std::size_t offset, T value, char const *description) {
+  patch(original, offset, value);
+  write_file(path, original);
+  imx::capture_reader reader(path);
+  check(reader.next() == nullptr, description);
+}
+
+// Writes two frames that only differ in their display size
+void round_trip(std::string const &path, scene &frames) {
+  ImFontAtlas atlas;
+  atlas.TexWidth = 512;
+  atlas.TexHeight = 256;
+  imx::capture_writer writer;
+  check(writer.open(path, atlas), "capture is created");
+  writer.write(frames.data);
+  frames.data.DisplaySize = ImVec2(800, 600);
+  writer.write(frames.data);
+  writer.close();
+
+  imx::capture_reader reader(path);
+  check(reader.valid(), "capture is valid");
+  check(same(reader.atlas_size(), ImVec2(512, 256)), "atlas size matches");
+  frames.data.DisplaySize = ImVec2(640, 480);
+  check_frame(reader.next(), frames.data);
+  frames.data.DisplaySize = ImVec2(800, 600);
+  check_frame(reader.next(), frames.data);
+  check(reader.next() == nullptr, "reading stops after the last frame");
+
+  reader.rewind();
+  frames.data.DisplaySize = ImVec2(640, 480);
+  check_frame(reader.next(), frames.data);
+}
+
+void damaged(std::string const &path, ImDrawData const &first_frame) {
+  auto const original = read_file(path);
+
+  auto truncated = original;
+  truncated.resize(truncated.size() - 8);
+  write_file(path, truncated);
+  {
+    imx::capture_reader reader(path);
+    check_frame(reader.next(), first_frame);
+    check(reader.next() == nullptr, "truncated frame is rejected");
+  }
+
+  expect_rejected(path, original, s_frame_lists_offset, 0xffffffffU,
+                  "list count beyond the frame is rejected");
+  expect_rejected(path, original, s_list_commands_offset, 0xffffffffU,
+                  "command count beyond the frame is rejected");
+  expect_rejected(path, original,
+                  s_first_command_offset + s_elem_count_offset, 7U,
+                  "elements beyond the indices of the list are rejected");
+  expect_rejected(path, original,
+                  s_first_command_offset + s_command_size +
+                      s_vtx_offset_offset,
+                  1U, "vertex offset beyond the vertices is rejected");
+  expect_rejected(path, original, s_first_index_offset, ImDrawIdx{5},
+                  "index beyond the vertices of the list is rejected");
+}
+
+} // namespace
+
+int main() {
+  auto path =
+      (std::filesystem::temp_directory_path() / "imx_capture_test.imxd")
+          .string();
+  scene frames;
+  round_trip(path, frames);
+  frames.data.DisplaySize = ImVec2(640, 480);
+  damaged(path, frames.data);
+  std::filesystem::remove(path);
+  return imx::test::result();
+}
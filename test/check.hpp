@@ -0,0 +1,31 @@
+#pragma once
+
+#include <fmt/core.h>
+
+// Minimal assertion helpers shared by the unit tests, failures are printed
+// and counted so one run reports every broken check
+
+namespace imx::test {
+
+inline int &failures() {
+  static int count = 0;
+  return count;
+}
+
+inline void check(bool condition, char const *description) {
+  if (!condition) {
+    fmt::print("FAILED: {}\n", description);
+    ++failures();
+  }
+}
+
+// Exit code of the test executable
+inline int result() {
+  if (failures() != 0) {
+    fmt::print("{} checks failed\n", failures());
+    return 1;
+  }
+  return 0;
+}
+
+} // namespace imx::test
@@ -0,0 +1,312 @@
+#include "imx/imx.hpp"
+#include "imx/texture.hpp"
+#include <algorithm>
+#include <array>
+#include <blend2d.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <imgui.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Renders one canonical scene offscreen and compares it with its golden
+// image and its frame time with a stored baseline.
+//
+// imx_golden scene golden_directory font
+//
+// A missing golden image or font fails the test. With IMX_UPDATE_GOLDENS
+// set the golden image is written instead. Frame times only mean something
+// on the machine they were measured on, so the timing check is opt in: it
+// runs when a baseline exists or IMX_CHECK_TIMING is set, and updates only
+// write a baseline with IMX_CHECK_TIMING set. IMX_PIXEL_TOLERANCE,
+// IMX_PIXEL_BUDGET and IMX_TIME_TOLERANCE override the thresholds.
+
+namespace {
+
+using clock_type = std::chrono::steady_clock;
+
+constexpr int s_width = 800;
+constexpr int s_height = 600;
+// Frames before the measured ones, so windows are laid out and caches warm
+constexpr int s_warmup = 5;
+constexpr int s_frames = 30;
+
+double setting(char const *name, double fallback) {
+  char const *value = std::getenv(name);
+  return value != nullptr ? std::atof(value) : fallback;
+}
+
+void place_next_window() {
+  ImGui::SetNextWindowPos(ImVec2(10, 10), ImGuiCond_Always);
+  ImGui::SetNextWindowSize(ImVec2(s_width - 20, s_height - 20),
+                           ImGuiCond_Always);
+}
+
+void begin_window(char const *name) {
+  place_next_window();
+  ImGui::Begin(name);
+}
+
+void demo_scene() {
+  place_next_window();
+  ImGui::ShowDemoWindow();
+}
+
+void widgets_scene() {
+  static bool s_check = true;
+  static float s_value = 0.35F;
+  static int s_item = 1;
+  begin_window("widgets");
+  ImGui::Button("Button");
+  ImGui::SameLine();
+  ImGui::Checkbox("Checkbox", &s_check);
+  ImGui::SliderFloat("Slider", &s_value, 0.F, 1.F);
+  ImGui::Combo("Combo", &s_item, "First\0Second\0Third\0");
+  ImGui::ProgressBar(s_value);
+  if (ImGui::TreeNodeEx("Tree", ImGuiTreeNodeFlags_DefaultOpen)) {
+    ImGui::BulletText("Leaf");
+    ImGui::TreePop();
+  }
+  if (ImGui::BeginTable("table", 3,
+                        ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+    for (int row = 0; row < 8; ++row) {
+      ImGui::TableNextRow();
+      for (int column = 0; column < 3; ++column) {
+        ImGui::TableSetColumnIndex(column);
+        ImGui::Text("Cell %d,%d", row, column);
+      }
+    }
+    ImGui::EndTable();
+  }
+  ImGui::End();
+}
+
+void text_scene() {
+  begin_window("text");
+  ImGui::TextUnformatted("The quick brown fox jumps over the lazy dog");
+  ImGui::TextColored(ImVec4(1.F, 0.5F, 0.2F, 1.F),
+                     "Coloured text 0123456789");
+  ImGui::TextWrapped(
+      "Wrapped text keeps going until it reaches the edge of the window and "
+      "then continues on the next line, exercising long runs of glyphs that "
+      "share a colour and a font.");
+  for (float scale : {0.75F, 1.5F, 2.F}) {
+    ImGui::SetWindowFontScale(scale);
+    ImGui::Text("Scaled %.2f", scale);
+  }
+  ImGui::SetWindowFontScale(1.F);
+  ImGui::End();
+}
+
+void color_picker_scene() {
+  static std::array<float, 4> s_color{0.2F, 0.6F, 0.9F, 0.8F};
+  begin_window("color picker");
+  ImGui::ColorPicker4("Picker", s_color.data(),
+                      ImGuiColorEditFlags_AlphaBar |
+                          ImGuiColorEditFlags_AlphaPreviewHalf);
+  ImGui::ColorEdit4("Edit", s_color.data());
+  ImGui::End();
+}
+
+std::vector<ImTextureID> g_textures;
+
+void create_textures() {
+  BLImage checker(64, 64, BL_FORMAT_PRGB32);
+  BLContext ctx(checker, BLContextCreateInfo{});
+  ctx.fillAll(BLRgba32(0xFFFFFFFFU));
+  ctx.setFillStyle(BLRgba32(0xFF3060C0U));
+  for (int y = 0; y < 8; ++y) {
+    for (int x = y % 2; x < 8; x += 2) {
+      ctx.fillRect(BLRectI(x * 8, y * 8, 8, 8));
+    }
+  }
+  ctx.end();
+  auto nearest = imx::add_texture(checker);
+  imx::set_texture_filter(nearest, imx::texture_filter::nearest);
+  g_textures = {imx::add_texture(checker), nearest};
+}
+
+void images_scene() {
+  begin_window("images");
+  for (auto texture : g_textures) {
+    ImGui::Image(texture, ImVec2(64, 64));
+    ImGui::SameLine();
+    ImGui::Image(texture, ImVec2(200, 200));
+    ImGui::SameLine();
+    ImGui::Image(texture, ImVec2(32, 32), ImVec2(0.25F, 0.25F),
+                 ImVec2(0.75F, 0.75F), ImVec4(1.F, 0.8F, 0.8F, 1.F));
+  }
+  ImGui::End();
+}
+
+struct scene {
+  std::string_view name;
+  void (*draw)();
+};
+
+constexpr std::array<scene, 5> s_scenes{{{"demo", demo_scene},
+                                         {"widgets", widgets_scene},
+                                         {"text", text_scene},
+                                         {"color_picker", color_picker_scene},
+                                         {"images", images_scene}}};
+
+// Fraction of pixels where any channel differs by more than tolerance
+double mismatch(BLImage const &actual, BLImage const &expected,
+                int tolerance) {
+  BLImageData a{};
+  BLImageData b{};
+  actual.getData(&a);
+  expected.getData(&b);
+  std::size_t different = 0;
+  for (int y = 0; y < a.size.h; ++y) {
+    auto const *row_a = static_cast<std::uint8_t const *>(a.pixelData) +
+                        static_cast<std::ptrdiff_t>(y) * a.stride;
+    auto const *row_b = static_cast<std::uint8_t const *>(b.pixelData) +
+                        static_cast<std::ptrdiff_t>(y) * b.stride;
+    for (int x = 0; x < a.size.w * 4; x += 4) {
+      for (int channel = 0; channel < 4; ++channel) {
+        if (std::abs(row_a[x + channel] - row_b[x + channel]) > tolerance) {
+          ++different;
+          break;
+        }
+      }
+    }
+  }
+  return static_cast<double>(different) /
+         (static_cast<double>(a.size.w) * a.size.h);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 4) {
+    fmt::print("usage: imx_golden scene golden_directory font\n");
+    return 1;
+  }
+  std::string_view name = argv[1];
+  auto found = std::find_if(s_scenes.begin(), s_scenes.end(),
+                            [&](auto const &s) { return s.name == name; });
+  if (found == s_scenes.end()) {
+    fmt::print("Unknown scene {}\n", name);
+    return 1;
+  }
+  std::filesystem::path directory = argv[2];
+  auto golden_path = directory / (std::string(name) + ".png");
+  auto timing_path = directory / (std::string(name) + ".timing");
+  bool update = std::getenv("IMX_UPDATE_GOLDENS") != nullptr;
+  bool check_timing = std::getenv("IMX_CHECK_TIMING") != nullptr;
+  if (!std::filesystem::exists(argv[3])) {
+    fmt::print("Font {} not found\n", argv[3]);
+    return 1;
+  }
+  if (!update && !std::filesystem::exists(golden_path)) {
+    fmt::print("No golden image {}, build the update_goldens target to "
+               "create it\n",
+               golden_path.string());
+    return 1;
+  }
+
+  ImGui::CreateContext();
+  auto &io = ImGui::GetIO();
+  io.IniFilename = nullptr;
+  io.DeltaTime = 1.F / 60.F;
+  ImGui::StyleColorsDark();
+  BLImage image(s_width, s_height, BL_FORMAT_PRGB32);
+  BLImageData target{};
+  image.getData(&target);
+  // Rendering on the calling thread keeps timings comparable between
+  // machines
+  if (!imx::initialize_headless(argv[3], target)) {
+    return 1;
+  }
+  create_textures();
+
+  std::vector<double> times;
+  for (int frame = 0; frame < s_warmup + s_frames; ++frame) {
+    auto start = clock_type::now();
+    if (!imx::begin_frame()) {
+      return 1;
+    }
+    ImGui::NewFrame();
+    found->draw();
+    ImGui::Render();
+    if (!imx::draw_frame(ImGui::GetDrawData()) || !imx::end_frame()) {
+      return 1;
+    }
+    if (frame >= s_warmup) {
+      times.push_back(std::chrono::duration<double, std::micro>(
+                          clock_type::now() - start)
+                          .count());
+    }
+  }
+  auto middle = times.begin() + static_cast<std::ptrdiff_t>(times.size() / 2);
+  std::nth_element(times.begin(), middle, times.end());
+  double frame_us = *middle;
+
+  if (update) {
+    std::filesystem::create_directories(directory);
+    if (check_timing) {
+      std::ofstream(timing_path) << frame_us << '\n';
+    }
+    if (image.writeToFile(golden_path.string().c_str()) != BL_SUCCESS) {
+      fmt::print("Failed to write {}\n", golden_path.string());
+      return 1;
+    }
+    fmt::print("Updated {} ({:.1f} us per frame)\n", golden_path.string(),
+               frame_us);
+    return 0;
+  }
+
+  bool passed = true;
+  BLImage expected;
+  if (expected.readFromFile(golden_path.string().c_str()) != BL_SUCCESS) {
+    fmt::print("Failed to read {}\n", golden_path.string());
+    return 1;
+  }
+  expected.convert(BL_FORMAT_PRGB32);
+  auto tolerance = static_cast<int>(setting("IMX_PIXEL_TOLERANCE", 8));
+  auto budget = setting("IMX_PIXEL_BUDGET", 0.001);
+  if (expected.width() != image.width() ||
+      expected.height() != image.height()) {
+    fmt::print("Golden image is {}x{}, rendered {}x{}\n", expected.width(),
+               expected.height(), image.width(), image.height());
+    passed = false;
+  } else if (auto different = mismatch(image, expected, tolerance);
+             different > budget) {
+    fmt::print("{:.3f}% of pixels differ by more than {}, {:.3f}% allowed\n",
+               different * 100, tolerance, budget * 100);
+    passed = false;
+  }
+  if (!passed) {
+    auto actual_path = std::string(name) + "_actual.png";
+    image.writeToFile(actual_path.c_str());
+    fmt::print("Rendered image written to {}\n", actual_path);
+  }
+
+  double baseline_us = 0;
+  bool has_baseline =
+      std::ifstream(timing_path) >> baseline_us && baseline_us > 0;
+  if (check_timing && !has_baseline) {
+    fmt::print("No frame time baseline {}, run with IMX_UPDATE_GOLDENS=1 and "
+               "IMX_CHECK_TIMING=1 to measure it\n",
+               timing_path.string());
+    passed = false;
+  }
+  if (has_baseline) {
+    auto limit = baseline_us * (1 + setting("IMX_TIME_TOLERANCE", 0.25));
+    fmt::print("{:.1f} us per frame, baseline {:.1f} us\n", frame_us,
+               baseline_us);
+    if (frame_us > limit) {
+      fmt::print("Frame time exceeds the baseline by more than {:.0f}%\n",
+                 (limit / baseline_us - 1) * 100);
+      passed = false;
+    }
+  }
+  ImGui::DestroyContext();
+  return passed ? 0 : 1;
+}
@@ -0,0 +1,116 @@
+#include "check.hpp"
+#include "texture_registry.hpp"
+#include <blend2d.h>
+#include <cstddef>
+
+// Handle validation, reference counting and eviction of the texture
+// registry, driven directly without a renderer.
+
+namespace {
+
+using imx::test::check;
+
+BLImage make_image() { return BLImage(64, 64, BL_FORMAT_PRGB32); }
+
+constexpr std::size_t s_image_bytes = 64 * 64 * 4;
+
+void draw(imx::texture_registry &registry, ImTextureID texture) {
+  registry.use(texture, BLSize(64, 64));
+}
+
+void stale_handles() {
+  imx::texture_registry registry;
+  auto texture = registry.add(make_image());
+  check(texture != nullptr, "add returns a handle");
+  check(registry.find(texture) != nullptr, "added texture is found");
+  check(registry.release(texture), "release of a live handle succeeds");
+  check(registry.find(texture) == nullptr, "removed texture is not found");
+  check(!registry.retain(texture), "removed handle can not be retained");
+  check(!registry.release(texture), "removed handle can not be released");
+  check(registry.info(texture).references == 0,
+        "removed handle reports no references");
+
+  // The slot is reused, the old handle must not reach the new texture
+  auto reused = registry.add(make_image());
+  check(reused != texture, "reused slot gets a new handle");
+  check(registry.find(texture) == nullptr,
+        "old handle stays invalid after its slot is reused");
+  check(registry.find(reused) != nullptr, "new handle is valid");
+  check(registry.find(nullptr) == nullptr, "null handle is invalid");
+}
+
+void reference_counting() {
+  imx::texture_registry registry;
+  auto texture = registry.add(make_image());
+  check(registry.info(texture).references == 1, "add starts one reference");
+  check(registry.retain(texture), "retain succeeds");
+  check(registry.info(texture).references == 2, "retain adds a reference");
+  check(registry.release(texture), "first release succeeds");
+  check(registry.find(texture) != nullptr,
+        "texture survives while references remain");
+  check(registry.release(texture), "last release succeeds");
+  check(registry.find(texture) == nullptr,
+        "texture is destroyed with the last reference");
+  check(registry.memory().textures == 0, "no textures remain");
+  check(registry.memory().used_bytes == 0, "no memory remains");
+}
+
+void eviction() {
+  imx::texture_registry registry;
+  auto oldest = registry.add(make_image());
+  auto middle = registry.add(make_image());
+  auto newest = registry.add(make_image());
+  check(registry.memory().used_bytes == 3 * s_image_bytes,
+        "memory counts every texture");
+
+  registry.next_frame();
+  draw(registry, oldest);
+  registry.next_frame();
+  draw(registry, middle);
+  draw(registry, newest);
+  registry.next_frame();
+  draw(registry, middle);
+  draw(registry, newest);
+
+  // oldest was drawn two frames ago and goes first
+  registry.set_budget(2 * s_image_bytes);
+  check(registry.find(oldest) == nullptr,
+        "least recently used texture is evicted");
+  check(registry.info(oldest).references == 1,
+        "evicted texture keeps its handle");
+  check(registry.find(middle) != nullptr && registry.find(newest) != nullptr,
+        "recently used textures stay resident");
+  check(registry.memory().evictions == 1, "one texture is evicted");
+  check(registry.memory().used_bytes <= 2 * s_image_bytes,
+        "memory is within the budget");
+
+  // Both remaining textures were drawn in this or the last frame and are
+  // kept even though they exceed the budget
+  registry.set_budget(s_image_bytes);
+  check(registry.find(middle) != nullptr && registry.find(newest) != nullptr,
+        "textures drawn in the last frame are never evicted");
+
+  registry.next_frame();
+  draw(registry, newest);
+  check(registry.find(middle) != nullptr,
+        "texture drawn in the previous frame is kept");
+  registry.next_frame();
+  check(registry.find(middle) == nullptr,
+        "texture not drawn for two frames is evicted");
+  check(registry.find(newest) != nullptr,
+        "texture drawn in the previous frame survives eviction");
+
+  check(registry.update(oldest, make_image()),
+        "evicted texture can be updated");
+  check(registry.find(oldest) != nullptr,
+        "update makes an evicted texture resident");
+}
+
+} // namespace
+
+int main() {
+  stale_handles();
+  reference_counting();
+  eviction();
+  return imx::test::result();
+}